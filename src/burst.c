@@ -0,0 +1,98 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "burst.h"
+#include "energy.h"
+
+void burst_init(struct burst_detector *d)
+{
+     d->epoch = 0;
+     d->has_last = false;
+     d->t_last = 0;
+     d->y_last = 0.0;
+     d->rate = 0.0;
+     d->cusum = 0.0;
+     d->t_rise = 0;
+     d->t_excess = 0;
+     d->excess = 0.0;
+     d->in_burst = false;
+}
+
+bool burst_add(struct burst_detector *d, uint64_t t, uint64_t epoch,
+	       uint16_t value, struct burst_event *event)
+{
+     if (!d->has_last || epoch != d->epoch) {
+	  burst_init(d);
+	  d->epoch = epoch;
+     }
+
+     double v = adc_to_voltage(value);
+     if (!d->has_last) {
+	  d->has_last = true;
+	  d->t_last = t;
+	  d->y_last = v*v;
+	  return false;
+     }
+
+     double dt = (t-d->t_last)/1000000000.0;
+     /* Low-pass filter against ADC noise */
+     double alpha = dt/BURST_SMOOTHING_TAU;
+     if (alpha > 1.0)
+	  alpha = 1.0;
+     double y = d->y_last + alpha*(v*v-d->y_last);
+     /* Drop of V^2 in excess of the idle baseline */
+     double excess = (d->y_last-y) - d->rate*dt;
+     d->t_last = t;
+     d->y_last = y;
+
+     /* Drift allowance and threshold in V^2 (E = 0.5*C*V^2) */
+     double drift = 2.0*BURST_DRIFT_POWER/CAPACITANCE*dt;
+     double threshold = 2.0*BURST_THRESHOLD_ENERGY/CAPACITANCE;
+
+     bool ended = false;
+     if (d->cusum == 0.0) {
+	  d->t_rise = t;
+	  d->excess = 0.0;
+     }
+     d->cusum += excess - drift;
+     if (d->cusum > 0.0) {
+	  d->excess += excess;
+	  if (excess > drift)
+	       d->t_excess = t;
+	  if (d->cusum > threshold)
+	       d->in_burst = true;
+     } else {
+	  d->cusum = 0.0;
+	  if (d->in_burst) {
+	       event->epoch = epoch;
+	       event->t_start = d->t_rise;
+	       event->t_end = d->t_excess;
+	       event->energy = 0.5*CAPACITANCE*d->excess;
+	       event->idle_power = 0.5*CAPACITANCE*d->rate;
+	       d->in_burst = false;
+	       ended = true;
+	  }
+     }
+
+     /* Only track the idle baseline outside of bursts. */
+     if (!d->in_burst)
+	  d->rate += excess/BURST_BASELINE_TAU;
+
+     return ended;
+}
@@ -0,0 +1,104 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BURST_H
+#define BURST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Parameters of the CUSUM change-point detector. The drift allowance is
+   half of the minimum increase of power over the idle baseline to be
+   detected; a burst is reported when the excess energy exceeds the
+   threshold. One ADC count corresponds to about 30 uJ at 2.5 V, so the
+   threshold must be well above this to suppress ADC noise. */
+#define BURST_DRIFT_POWER 0.001
+#define BURST_THRESHOLD_ENERGY 0.0001
+
+/* Time constant of the low-pass filter applied to V^2 against ADC noise
+   in seconds. */
+#define BURST_SMOOTHING_TAU 0.01
+
+/* Time constant of the idle baseline (exponentially weighted moving
+   average of the V^2 slope outside of bursts) in seconds. */
+#define BURST_BASELINE_TAU 10.0
+
+/**
+ * An activity burst.
+ */
+struct burst_event {
+     uint64_t epoch;
+     uint64_t t_start;
+     uint64_t t_end;
+
+     /* Energy consumed in addition to the idle power during the burst
+	[J]. */
+     double energy;
+
+     /* Idle power before the burst [W]. */
+     double idle_power;
+};
+
+/**
+ * Streaming detector of activity bursts in the discharge trace.
+ *
+ * Between bursts, the device under test consumes the idle power, i.e., V^2
+ * decreases with a constant slope. A burst shows up as an excess drop of
+ * V^2 within a short time. The detector accumulates the excess drop of the
+ * low-pass filtered V^2 per sample (CUSUM) and reports a burst when the sum
+ * exceeds a threshold. The burst ends when the sum returns to zero.
+ */
+struct burst_detector {
+     uint64_t epoch;
+     bool has_last;
+     uint64_t t_last;
+     /* Filtered V^2 of the last sample */
+     double y_last;
+
+     /* Idle baseline: drop of V^2 per second. */
+     double rate;
+
+     double cusum;
+     uint64_t t_rise;
+     uint64_t t_excess;
+     double excess;
+     bool in_burst;
+};
+
+/**
+ * Initialize a burst detector.
+ *
+ * @param d the detector
+ */
+void burst_init(struct burst_detector *d);
+
+/**
+ * Add a sample. When a new epoch starts, the detector is reset.
+ *
+ * @param d the detector
+ * @param t timestamp of the sample in nanoseconds
+ * @param epoch epoch of the sample
+ * @param value ADC count
+ * @param event the burst, if a burst ended with this sample
+ * @return true if a burst ended with this sample
+ */
+bool burst_add(struct burst_detector *d, uint64_t t, uint64_t epoch,
+	       uint16_t value, struct burst_event *event);
+
+#endif
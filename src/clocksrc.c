@@ -0,0 +1,177 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "clocksrc.h"
+
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+/**
+ * Check whether the hardware counter runs at a constant rate, also in
+ * power-saving states. The ARM generic timer has a constant frequency by
+ * architecture; the x86 time stamp counter only if it is invariant
+ * (CPUID 0x80000007, EDX bit 8; constant_tsc and nonstop_tsc in
+ * /proc/cpuinfo).
+ *
+ * @return true if the counter is invariant.
+ */
+static bool is_invariant_counter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+     unsigned int eax, ebx, ecx, edx;
+     if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+	  return false;
+     return ((edx & (1u << 8)) != 0);
+#else
+     return true;
+#endif
+}
+
+/**
+ * Read CLOCK_MONOTONIC and the hardware counter at (nearly) the same time.
+ * The counter is read before and after CLOCK_MONOTONIC, and the attempt
+ * with the shortest time in between is used, so an interrupt or
+ * preemption does not spoil the calibration.
+ *
+ * @param count counter value at the time returned
+ * @return CLOCK_MONOTONIC time in nanoseconds
+ */
+static uint64_t read_pair(uint64_t *count)
+{
+     uint64_t t_ns = 0;
+     uint64_t min_window = UINT64_MAX;
+     *count = 0;
+     for (int i = 0; i < CLOCKSRC_READ_ATTEMPTS; i++) {
+	  struct timespec t;
+	  uint64_t c0 = clocksrc_read_counter();
+	  clock_gettime(CLOCK_MONOTONIC, &t);
+	  uint64_t c1 = clocksrc_read_counter();
+	  if (c1-c0 < min_window) {
+	       min_window = c1-c0;
+	       *count = c0+(c1-c0)/2;
+	       t_ns = 1000000000ull*t.tv_sec + t.tv_nsec;
+	  }
+     }
+     
+     return t_ns;
+}
+
+/**
+ * Publish new conversion parameters to the reading thread.
+ */
+static void publish(struct clocksrc *cs, uint64_t base_count,
+		    uint64_t base_ns, uint64_t mult)
+{
+     __atomic_store_n(&cs->seq, cs->seq+1, __ATOMIC_RELAXED);
+     __atomic_thread_fence(__ATOMIC_RELEASE);
+     __atomic_store_n(&cs->base_count, base_count, __ATOMIC_RELAXED);
+     __atomic_store_n(&cs->base_ns, base_ns, __ATOMIC_RELAXED);
+     __atomic_store_n(&cs->mult, mult, __ATOMIC_RELAXED);
+     __atomic_store_n(&cs->seq, cs->seq+1, __ATOMIC_RELEASE);
+}
+
+int clocksrc_init(struct clocksrc *cs, bool use_counter)
+{
+     cs->is_counter = false;
+     cs->seq = 0;
+     cs->frequency = 0.0;
+     cs->last_ns = 0;
+     if (!use_counter)
+	  return 0;
+     
+#ifndef CLOCKSRC_HAS_COUNTER
+     errno = ENOTSUP;
+     return -1;
+#endif
+
+     if (!is_invariant_counter()) {
+	  errno = ENOTSUP;
+	  return -1;
+     }
+
+     uint64_t c0, c1;
+     uint64_t t0 = read_pair(&c0);
+     struct timespec calibration;
+     calibration.tv_sec = 0;
+     calibration.tv_nsec = CLOCKSRC_CALIBRATION_NS;
+     clock_nanosleep(CLOCK_MONOTONIC, 0, &calibration, NULL);
+     uint64_t t1 = read_pair(&c1);
+     if (c1 <= c0 || t1 <= t0) {
+	  // Counter not running or not accessible.
+	  errno = ENOTSUP;
+	  return -1;
+     }
+
+     double ns_per_count = (double) (t1-t0)/(c1-c0);
+     cs->frequency = 1000000000.0/ns_per_count;
+     publish(cs, c1, t1, (uint64_t) (ns_per_count*(1ull << CLOCKSRC_SHIFT) +
+				     0.5));
+     cs->ref_count = c1;
+     cs->ref_ns = t1;
+     // Refine the rate soon; the calibration interval doubles with every
+     // calibration up to CLOCKSRC_RECALIBRATION_NS.
+     cs->interval_ns = 2*CLOCKSRC_CALIBRATION_NS;
+     cs->is_counter = true;
+
+     return 0;
+}
+
+uint64_t clocksrc_calibrate(struct clocksrc *cs)
+{
+     if (!cs->is_counter)
+	  return CLOCKSRC_RECALIBRATION_NS;
+     
+     uint64_t c;
+     uint64_t t = read_pair(&c);
+     if (c <= cs->ref_count || t <= cs->ref_ns)
+	  return cs->interval_ns;
+
+     // Rate since the last calibration, and offset of the clock source to
+     // CLOCK_MONOTONIC at the current counter value.
+     double ns_per_count = (double) (t-cs->ref_ns)/(c-cs->ref_count);
+     uint64_t now = clocksrc_to_ns(c, cs->base_count, cs->base_ns, cs->mult);
+     double offset = (double) (int64_t) (t-now);
+
+     if (2*cs->interval_ns <= CLOCKSRC_RECALIBRATION_NS)
+	  cs->interval_ns *= 2;
+     else
+	  cs->interval_ns = CLOCKSRC_RECALIBRATION_NS;
+
+     // Slew out the offset until the next calibration.
+     double slew = offset/cs->interval_ns;
+     if (slew > CLOCKSRC_MAX_SLEW)
+	  slew = CLOCKSRC_MAX_SLEW;
+     else if (slew < -CLOCKSRC_MAX_SLEW)
+	  slew = -CLOCKSRC_MAX_SLEW;
+     publish(cs, c, now, (uint64_t) (ns_per_count*(1.0+slew)*
+				      (1ull << CLOCKSRC_SHIFT) + 0.5));
+     cs->ref_count = c;
+     cs->ref_ns = t;
+     cs->frequency = 1000000000.0/ns_per_count;
+
+     return cs->interval_ns;
+}
+
+double clocksrc_frequency(const struct clocksrc *cs)
+{
+     return cs->frequency;
+}
@@ -0,0 +1,200 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef CLOCKSRC_H
+#define CLOCKSRC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Interval after which the clock source is re-calibrated against
+   CLOCK_MONOTONIC [ns]. */
+#define CLOCKSRC_RECALIBRATION_NS 1000000000ull
+
+/* Duration of the initial calibration [ns]. */
+#define CLOCKSRC_CALIBRATION_NS 10000000ull
+
+/* Attempts to read the counter and CLOCK_MONOTONIC at the same time per
+   calibration. */
+#define CLOCKSRC_READ_ATTEMPTS 5
+
+/* Fixed-point fraction bits of the nanoseconds per counter tick. */
+#define CLOCKSRC_SHIFT 24
+
+/* Maximum rate adjustment for slewing out the offset to CLOCK_MONOTONIC
+   (1000 ppm). */
+#define CLOCKSRC_MAX_SLEW 0.001
+
+#if defined(__aarch64__) || \
+     (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7) || \
+     defined(__x86_64__) || defined(__i386__)
+#define CLOCKSRC_HAS_COUNTER
+#endif
+
+/**
+ * Timestamp source reading a hardware counter directly instead of calling
+ * clock_gettime(): the virtual counter of the ARM generic timer
+ * (CNTVCT, Raspberry Pi 2 and newer) or the x86 time stamp counter, which
+ * is only used if it is invariant (constant rate in all P-, C-, and
+ * T-states). Counter values are converted to CLOCK_MONOTONIC nanoseconds by
+ * a fixed-point multiplication relative to a base counter value.
+ *
+ * The clock source is re-calibrated periodically by clocksrc_calibrate(),
+ * which is called by another thread than the thread reading the time, so
+ * the reading thread never calls clock_gettime(). Re-calibration does not
+ * step the time: the new base is the time of the clock source at the
+ * current counter value, and the offset to CLOCK_MONOTONIC is slewed out
+ * by adjusting the rate until the next re-calibration. The conversion
+ * parameters are published to the reading thread by a sequence counter.
+ * Only one thread may read the time.
+ */
+struct clocksrc {
+     bool is_counter;
+     /* Conversion parameters, written by the calibrating thread while seq
+	is odd: counter value and time of the base, and nanoseconds per
+	counter tick << CLOCKSRC_SHIFT (including slew). */
+     uint32_t seq;
+     uint64_t base_count;
+     uint64_t base_ns;
+     uint64_t mult;
+     /* Counter value and CLOCK_MONOTONIC time of the last calibration,
+	and the interval until the next calibration [ns]. Only accessed by
+	the calibrating thread. */
+     uint64_t ref_count;
+     uint64_t ref_ns;
+     uint64_t interval_ns;
+     /* Counter frequency measured by the last calibration [Hz]. */
+     double frequency;
+     /* Last time returned, to keep time monotonic. Only accessed by the
+	reading thread. */
+     uint64_t last_ns;
+};
+
+/**
+ * Initialize a clock source and calibrate it (takes
+ * CLOCKSRC_CALIBRATION_NS).
+ *
+ * @param cs the clock source
+ * @param use_counter true to use the hardware counter; false to use
+ * clock_gettime()
+ * @return 0 on success; -1 if the hardware counter is not supported on
+ * this platform or not invariant.
+ */
+int clocksrc_init(struct clocksrc *cs, bool use_counter);
+
+/**
+ * Re-calibrate the clock source against CLOCK_MONOTONIC. Must be called
+ * by one thread, but not by the thread reading the time.
+ *
+ * @param cs the clock source
+ * @return time until the next re-calibration [ns]; the interval doubles
+ * with every calibration up to CLOCKSRC_RECALIBRATION_NS.
+ */
+uint64_t clocksrc_calibrate(struct clocksrc *cs);
+
+/**
+ * Frequency of the hardware counter according to the last calibration.
+ *
+ * @param cs the clock source
+ * @return frequency in Hertz, or 0 if no hardware counter is used.
+ */
+double clocksrc_frequency(const struct clocksrc *cs);
+
+/**
+ * Read the hardware counter.
+ *
+ * @return counter value
+ */
+static inline uint64_t clocksrc_read_counter(void)
+{
+#if defined(__aarch64__)
+     uint64_t c;
+     __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (c) : :
+			   "memory");
+     return c;
+#elif defined(__arm__) && defined(CLOCKSRC_HAS_COUNTER)
+     uint64_t c;
+     __asm__ __volatile__ ("isb; mrrc p15, 1, %Q0, %R0, c14" : "=r" (c) : :
+			   "memory");
+     return c;
+#elif defined(CLOCKSRC_HAS_COUNTER)
+     uint32_t lo, hi;
+     __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+     return ((uint64_t) hi << 32) | lo;
+#else
+     return 0;
+#endif
+}
+
+/**
+ * Convert a counter value to nanoseconds.
+ *
+ * @param count the counter value
+ * @param base_count counter value of the base
+ * @param base_ns time of the base [ns]
+ * @param mult nanoseconds per counter tick << CLOCKSRC_SHIFT
+ * @return time [ns]
+ */
+static inline uint64_t clocksrc_to_ns(uint64_t count, uint64_t base_count,
+				      uint64_t base_ns, uint64_t mult)
+{
+     // The counter may have been read before the base was updated.
+     if (count >= base_count)
+	  return base_ns + (((count-base_count)*mult) >> CLOCKSRC_SHIFT);
+     else
+	  return base_ns - (((base_count-count)*mult) >> CLOCKSRC_SHIFT);
+}
+
+/**
+ * Get the current time.
+ *
+ * @param cs the clock source
+ * @return current time in nanoseconds (CLOCK_MONOTONIC)
+ */
+static inline uint64_t clocksrc_now(struct clocksrc *cs)
+{
+     if (!cs->is_counter) {
+	  struct timespec t;
+	  clock_gettime(CLOCK_MONOTONIC, &t);
+	  return 1000000000ull*t.tv_sec + t.tv_nsec;
+     }
+
+     uint64_t count = clocksrc_read_counter();
+     uint32_t seq;
+     uint64_t base_count, base_ns, mult;
+     do {
+	  seq = __atomic_load_n(&cs->seq, __ATOMIC_ACQUIRE);
+	  base_count = __atomic_load_n(&cs->base_count, __ATOMIC_RELAXED);
+	  base_ns = __atomic_load_n(&cs->base_ns, __ATOMIC_RELAXED);
+	  mult = __atomic_load_n(&cs->mult, __ATOMIC_RELAXED);
+	  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+     } while ((seq & 1) != 0 ||
+	      __atomic_load_n(&cs->seq, __ATOMIC_RELAXED) != seq);
+     
+     uint64_t t_ns = clocksrc_to_ns(count, base_count, base_ns, mult);
+     if (t_ns < cs->last_ns)
+	  t_ns = cs->last_ns;
+     cs->last_ns = t_ns;
+
+     return t_ns;
+}
+
+#endif
@@ -0,0 +1,427 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "colstore.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Maximum size of an encoded row of a single column: varint-encoded value
+   and run length (10 bytes each). */
+#define MAX_ENCODED_ROW 20
+
+/*
+ * Columns are encoded as sequences of signed integers, which are run-length
+ * encoded as pairs (zigzag varint value, varint run length-1):
+ *
+ * - timestamps: delta of deltas, which is close to zero for periodic
+ *   sampling
+ * - epochs: deltas, which are zero except at epoch boundaries
+ * - values: deltas, which are zero while the ADC count does not change
+ * - run lengths (change-only logging): number of samples minus 1, which is
+ *   zero for regular log files
+ */
+
+/**
+ * Write an unsigned LEB128 varint.
+ *
+ * @return pointer to the first byte after the varint.
+ */
+static uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+     while (v >= 0x80) {
+	  *p++ = (uint8_t) (v | 0x80);
+	  v >>= 7;
+     }
+     *p++ = (uint8_t) v;
+
+     return p;
+}
+
+/**
+ * Read an unsigned LEB128 varint.
+ *
+ * @return pointer to the first byte after the varint, or NULL if the
+ * varint exceeds the buffer.
+ */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+				 uint64_t *v)
+{
+     uint64_t result = 0;
+     unsigned int shift = 0;
+     
+     while (p < end && shift < 64) {
+	  uint8_t b = *p++;
+	  result |= ((uint64_t) (b & 0x7f)) << shift;
+	  if ((b & 0x80) == 0) {
+	       *v = result;
+	       return p;
+	  }
+	  shift += 7;
+     }
+
+     return NULL;
+}
+
+static uint64_t zigzag_encode(int64_t v)
+{
+     return (((uint64_t) v) << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t v)
+{
+     return (int64_t) (v >> 1) ^ -((int64_t) (v & 1));
+}
+
+/**
+ * Calculate the integer sequence of a column to be run-length encoded.
+ */
+static int64_t column_symbol(enum colstore_column col,
+			     const struct log_record *rec,
+			     const struct log_record *prev,
+			     const struct log_record *prevprev)
+{
+     switch (col) {
+     case COL_TIMESTAMP :
+	  return (int64_t) ((rec->timestamp-prev->timestamp)-
+			    (prev->timestamp-prevprev->timestamp));
+     case COL_EPOCH :
+	  return (int64_t) (rec->epoch-prev->epoch);
+     case COL_VALUE :
+	  return (int64_t) rec->value-(int64_t) prev->value;
+     default :
+	  return (int64_t) rec->count-1;
+     }
+}
+
+/**
+ * Encode a column of a row group.
+ *
+ * @return number of bytes written.
+ */
+static uint32_t encode_column(enum colstore_column col,
+			      const struct log_record *rows, uint32_t nrows,
+			      uint8_t *buf)
+{
+     /* Predecessors of the first row are zero. */
+     struct log_record zero;
+     memset(&zero, 0, sizeof(zero));
+     
+     uint8_t *p = buf;
+     uint32_t i = 0;
+     while (i < nrows) {
+	  const struct log_record *prev = (i >= 1 ? &rows[i-1] : &zero);
+	  const struct log_record *prevprev = (i >= 2 ? &rows[i-2] : &zero);
+	  int64_t symbol = column_symbol(col, &rows[i], prev, prevprev);
+	  uint32_t run = 1;
+	  while (i+run < nrows &&
+		 column_symbol(col, &rows[i+run], &rows[i+run-1],
+			       (i+run >= 2 ? &rows[i+run-2] : &zero)) == symbol)
+	       run++;
+	  p = put_varint(p, zigzag_encode(symbol));
+	  p = put_varint(p, run-1);
+	  i += run;
+     }
+
+     return p-buf;
+}
+
+/**
+ * Decode a column of a row group.
+ *
+ * @return 0 on success, or -1 if the data is corrupted.
+ */
+static int decode_column(enum colstore_column col, const uint8_t *p,
+			 const uint8_t *end, struct log_record *rows,
+			 uint32_t nrows)
+{
+     uint64_t last = 0;
+     uint64_t delta = 0;
+     uint32_t i = 0;
+     
+     while (i < nrows) {
+	  uint64_t zz, run;
+	  if ((p = get_varint(p, end, &zz)) == NULL ||
+	      (p = get_varint(p, end, &run)) == NULL || run >= nrows-i)
+	       return -1;
+	  int64_t symbol = zigzag_decode(zz);
+	  for (uint64_t j = 0; j <= run; j++, i++) {
+	       switch (col) {
+	       case COL_TIMESTAMP :
+		    delta += (uint64_t) symbol;
+		    last += delta;
+		    rows[i].timestamp = last;
+		    break;
+	       case COL_EPOCH :
+		    last += (uint64_t) symbol;
+		    rows[i].epoch = last;
+		    break;
+	       case COL_VALUE :
+		    last += (uint64_t) symbol;
+		    if (last > UINT16_MAX)
+			 return -1;
+		    rows[i].value = (uint16_t) last;
+		    break;
+	       default :
+		    if (symbol < 0 || symbol >= UINT32_MAX)
+			 return -1;
+		    rows[i].count = (uint32_t) symbol+1;
+		    break;
+	       }
+	  }
+     }
+
+     return 0;
+}
+
+/**
+ * Size of the buffer for the encoded columns of a row group.
+ *
+ * @param group_rows maximum number of rows per row group
+ * @return size in bytes, or 0 if group_rows is 0 or exceeds
+ * COLSTORE_MAX_GROUP_ROWS.
+ */
+static size_t group_buffer_size(uint32_t group_rows)
+{
+     if (group_rows == 0 || group_rows > COLSTORE_MAX_GROUP_ROWS)
+	  return 0;
+
+     return (size_t) COL_COUNT*group_rows*MAX_ENCODED_ROW;
+}
+
+int colstore_writer_open(struct colstore_writer *w, const char *path,
+			 uint32_t group_rows)
+{
+     size_t buf_size = group_buffer_size(group_rows);
+     if (buf_size == 0) {
+	  errno = EINVAL;
+	  return -1;
+     }
+     
+     w->group_rows = group_rows;
+     w->nrows = 0;
+     w->rows = malloc((size_t) group_rows*sizeof(struct log_record));
+     w->buf = malloc(buf_size);
+     if (w->rows == NULL || w->buf == NULL) {
+	  free(w->rows);
+	  free(w->buf);
+	  return -1;
+     }
+     
+     w->f = fopen(path, "w");
+     if (w->f == NULL) {
+	  free(w->rows);
+	  free(w->buf);
+	  return -1;
+     }
+
+     struct colstore_header header;
+     memset(&header, 0, sizeof(header));
+     strcpy(header.magic, COLSTORE_MAGIC);
+     header.group_rows = group_rows;
+     if (fwrite(&header, sizeof(header), 1, w->f) != 1) {
+	  colstore_writer_close(w);
+	  return -1;
+     }
+
+     return 0;
+}
+
+/**
+ * Encode and write the current row group.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+static int write_group(struct colstore_writer *w)
+{
+     struct colstore_group_header h;
+     memset(&h, 0, sizeof(h));
+     h.rows = w->nrows;
+     h.t_min = UINT64_MAX;
+     h.epoch_min = UINT64_MAX;
+     h.value_min = UINT16_MAX;
+     for (uint32_t i = 0; i < w->nrows; i++) {
+	  const struct log_record *rec = &w->rows[i];
+	  if (rec->timestamp < h.t_min)
+	       h.t_min = rec->timestamp;
+	  if (rec->timestamp > h.t_max)
+	       h.t_max = rec->timestamp;
+	  if (rec->epoch < h.epoch_min)
+	       h.epoch_min = rec->epoch;
+	  if (rec->epoch > h.epoch_max)
+	       h.epoch_max = rec->epoch;
+	  if (rec->value < h.value_min)
+	       h.value_min = rec->value;
+	  if (rec->value > h.value_max)
+	       h.value_max = rec->value;
+     }
+
+     uint8_t *p = w->buf;
+     for (int col = 0; col < COL_COUNT; col++) {
+	  h.column_size[col] = encode_column(col, w->rows, w->nrows, p);
+	  p += h.column_size[col];
+     }
+
+     if (fwrite(&h, sizeof(h), 1, w->f) != 1 ||
+	 fwrite(w->buf, 1, p-w->buf, w->f) != p-w->buf)
+	  return -1;
+     
+     w->nrows = 0;
+
+     return 0;
+}
+
+int colstore_writer_add(struct colstore_writer *w,
+			const struct log_record *rec)
+{
+     w->rows[w->nrows++] = *rec;
+     
+     if (w->nrows == w->group_rows)
+	  return write_group(w);
+
+     return 0;
+}
+
+int colstore_writer_close(struct colstore_writer *w)
+{
+     int status = 0;
+     
+     if (w->nrows > 0 && write_group(w) == -1)
+	  status = -1;
+
+     if (fclose(w->f) == EOF)
+	  status = -1;
+
+     free(w->rows);
+     free(w->buf);
+     w->f = NULL;
+     w->rows = NULL;
+     w->buf = NULL;
+
+     return status;
+}
+
+int colstore_reader_open(struct colstore_reader *r, const char *path)
+{
+     r->f = fopen(path, "r");
+     if (r->f == NULL)
+	  return -1;
+
+     struct colstore_header header;
+     if (fread(&header, sizeof(header), 1, r->f) != 1 ||
+	 memcmp(header.magic, COLSTORE_MAGIC, sizeof(COLSTORE_MAGIC)) != 0 ||
+	 group_buffer_size(header.group_rows) == 0) {
+	  fclose(r->f);
+	  return -1;
+     }
+
+     r->group_rows = header.group_rows;
+     r->buf_size = group_buffer_size(header.group_rows);
+     r->buf = malloc(r->buf_size);
+     if (r->buf == NULL) {
+	  fclose(r->f);
+	  return -1;
+     }
+
+     return 0;
+}
+
+int colstore_next_group(struct colstore_reader *r,
+			struct colstore_group_header *h)
+{
+     size_t n = fread(h, sizeof(*h), 1, r->f);
+
+     if (n == 1)
+	  return 1;
+
+     return (feof(r->f) ? 0 : -1);
+}
+
+/**
+ * Total size of the encoded columns of a row group.
+ */
+static uint64_t group_size(const struct colstore_group_header *h)
+{
+     uint64_t size = 0;
+     
+     for (int col = 0; col < COL_COUNT; col++)
+	  size += h->column_size[col];
+
+     return size;
+}
+
+/**
+ * Read the encoded columns of a row group into the buffer of the
+ * reader. Reading rather than seeking also detects truncated files.
+ */
+static int read_columns(struct colstore_reader *r,
+			const struct colstore_group_header *h)
+{
+     uint64_t size = group_size(h);
+     if (h->rows > r->group_rows || size > r->buf_size)
+	  return -1;
+
+     if (fread(r->buf, 1, size, r->f) != size)
+	  return -1;
+
+     return 0;
+}
+
+int colstore_skip_group(struct colstore_reader *r,
+			const struct colstore_group_header *h)
+{
+     return read_columns(r, h);
+}
+
+int colstore_read_group(struct colstore_reader *r,
+			const struct colstore_group_header *h,
+			struct log_record *rows)
+{
+     if (read_columns(r, h) == -1)
+	  return -1;
+
+     const uint8_t *p = r->buf;
+     for (int col = 0; col < COL_COUNT; col++) {
+	  if (decode_column(col, p, p+h->column_size[col], rows,
+			    h->rows) == -1)
+	       return -1;
+	  p += h->column_size[col];
+     }
+
+     return 0;
+}
+
+void colstore_reader_close(struct colstore_reader *r)
+{
+     if (r->f != NULL)
+	  fclose(r->f);
+     free(r->buf);
+     r->f = NULL;
+     r->buf = NULL;
+}
+
+bool colstore_group_overlaps(const struct colstore_group_header *h,
+			     const struct record_filter *f)
+{
+     return (h->rows > 0 &&
+	     h->epoch_max >= f->epoch_min && h->epoch_min <= f->epoch_max &&
+	     h->t_max >= f->t_min && h->t_min <= f->t_max &&
+	     h->value_max >= f->value_min && h->value_min <= f->value_max);
+}
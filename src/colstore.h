@@ -0,0 +1,187 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef COLSTORE_H
+#define COLSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "csvlog.h"
+#include "filter.h"
+
+/* Default number of rows per row group. */
+#define COLSTORE_GROUP_ROWS 65536
+
+/* Maximum number of rows per row group accepted by writer and reader. */
+#define COLSTORE_MAX_GROUP_ROWS (1u << 20)
+
+#define COLSTORE_MAGIC "LEMCOL2"
+
+/* Columns of a row group. */
+enum colstore_column {COL_TIMESTAMP, COL_EPOCH, COL_VALUE, COL_RUNLENGTH,
+		      COL_COUNT};
+
+/**
+ * Header of a columnar file. 
+ */
+struct colstore_header {
+     char magic[8];
+     uint32_t group_rows;
+     uint32_t reserved;
+};
+
+/**
+ * Header of a row group with statistics of its rows. The header is
+ * followed by the encoded columns.
+ */
+struct colstore_group_header {
+     uint32_t rows;
+     uint16_t value_min;
+     uint16_t value_max;
+
+     uint64_t t_min;
+     uint64_t t_max;
+
+     uint64_t epoch_min;
+     uint64_t epoch_max;
+
+     /* Size of the encoded columns in bytes. */
+     uint32_t column_size[COL_COUNT];
+     uint32_t reserved;
+};
+
+/**
+ * Writer creating a columnar file. 
+ */
+struct colstore_writer {
+     FILE *f;
+     uint32_t group_rows;
+
+     /* Rows of the current row group. */
+     struct log_record *rows;
+     uint32_t nrows;
+
+     /* Buffer for encoding columns. */
+     uint8_t *buf;
+};
+
+/**
+ * Reader of a columnar file.
+ */
+struct colstore_reader {
+     FILE *f;
+     uint32_t group_rows;
+
+     uint8_t *buf;
+     size_t buf_size;
+};
+
+/**
+ * Create a new columnar file.
+ *
+ * @param w the writer
+ * @param path path of the file
+ * @param group_rows maximum number of rows per row group (at most
+ * COLSTORE_MAX_GROUP_ROWS)
+ * @return 0 on success, or -1 in case of an error.
+ */
+int colstore_writer_open(struct colstore_writer *w, const char *path,
+			 uint32_t group_rows);
+
+/**
+ * Add a record. Records are written in row groups.
+ *
+ * @param w the writer
+ * @param rec the record
+ * @return 0 on success, or -1 in case of an error.
+ */
+int colstore_writer_add(struct colstore_writer *w,
+			const struct log_record *rec);
+
+/**
+ * Write the last (partial) row group and close the file. 
+ *
+ * @param w the writer
+ * @return 0 on success, or -1 in case of an error.
+ */
+int colstore_writer_close(struct colstore_writer *w);
+
+/**
+ * Open an existing columnar file.
+ *
+ * @param r the reader
+ * @param path path of the file
+ * @return 0 on success, or -1 in case of an error or invalid file.
+ */
+int colstore_reader_open(struct colstore_reader *r, const char *path);
+
+/**
+ * Read the header of the next row group. Afterwards, either
+ * colstore_read_group() or colstore_skip_group() must be called.
+ *
+ * @param r the reader
+ * @param h the header
+ * @return 1 if a header was read, 0 at the end of the file, or -1 in case
+ * of an error.
+ */
+int colstore_next_group(struct colstore_reader *r,
+			struct colstore_group_header *h);
+
+/**
+ * Skip the columns of a row group without decoding them.
+ *
+ * @param r the reader
+ * @param h the header of the row group
+ * @return 0 on success, or -1 in case of an error.
+ */
+int colstore_skip_group(struct colstore_reader *r,
+			const struct colstore_group_header *h);
+
+/**
+ * Read and decode the columns of a row group.
+ *
+ * @param r the reader
+ * @param h the header of the row group
+ * @param rows array for h->rows decoded records
+ * @return 0 on success, or -1 in case of an error or corrupted data.
+ */
+int colstore_read_group(struct colstore_reader *r,
+			const struct colstore_group_header *h,
+			struct log_record *rows);
+
+/**
+ * Close a columnar file.
+ *
+ * @param r the reader
+ */
+void colstore_reader_close(struct colstore_reader *r);
+
+/**
+ * Check whether a row group might contain records passing a filter
+ * according to the statistics of the row group.
+ *
+ * @param h the header of the row group
+ * @param f the filter
+ * @return false if no record of the row group can pass the filter.
+ */
+bool colstore_group_overlaps(const struct colstore_group_header *h,
+			     const struct record_filter *f);
+
+#endif
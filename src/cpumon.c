@@ -0,0 +1,196 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "cpumon.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Read the first line of a sysfs file.
+ *
+ * @param path path of the file
+ * @param buf buffer for the line without newline
+ * @param size size of the buffer
+ * @return 0 on success, or -1 in case of an error.
+ */
+static int read_line(const char *path, char *buf, size_t size)
+{
+     FILE *f = fopen(path, "r");
+     if (f == NULL)
+	  return -1;
+
+     int status = (fgets(buf, size, f) == NULL ? -1 : 0);
+     fclose(f);
+     if (status == 0)
+	  buf[strcspn(buf, "\n")] = '\0';
+
+     return status;
+}
+
+/**
+ * Read a number from a sysfs file.
+ *
+ * @param path path of the file
+ * @param base base of the number (0: decimal, or hexadecimal with 0x)
+ * @return the number, or -1 in case of an error.
+ */
+static long read_number(const char *path, int base)
+{
+     char buf[32];
+     if (read_line(path, buf, sizeof(buf)) == -1)
+	  return -1;
+
+     return strtol(buf, NULL, base);
+}
+
+/**
+ * Write a string to a sysfs file.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+static int write_line(const char *path, const char *s)
+{
+     FILE *f = fopen(path, "w");
+     if (f == NULL)
+	  return -1;
+
+     int status = (fputs(s, f) < 0 ? -1 : 0);
+     if (fclose(f) != 0)
+	  status = -1;
+
+     return status;
+}
+
+void cpumon_init(struct cpumon *m)
+{
+     long n = sysconf(_SC_NPROCESSORS_CONF);
+     if (n < 1)
+	  n = 1;
+     m->ncpus = (n > CPUMON_MAX_CPUS ? CPUMON_MAX_CPUS : n);
+     for (int i = 0; i < m->ncpus; i++)
+	  m->freq[i] = -1;
+     m->temp = -1;
+     m->throttled = -1;
+     m->is_governor_locked = false;
+}
+
+int cpumon_lock_governor(struct cpumon *m)
+{
+     char path[128];
+     for (int i = 0; i < m->ncpus; i++) {
+	  snprintf(path, sizeof(path), CPUMON_CPUFREQ_PATH, i,
+		   "scaling_governor");
+	  if (read_line(path, m->governors[i], CPUMON_GOVERNOR_LEN) == -1) {
+	       // CPU without cpufreq support or offline
+	       m->governors[i][0] = '\0';
+	       continue;
+	  }
+	  if (write_line(path, "performance") == -1) {
+	       int err = errno;
+	       m->governors[i][0] = '\0';
+	       m->is_governor_locked = true;
+	       cpumon_restore_governor(m);
+	       errno = err;
+	       return -1;
+	  }
+	  m->is_governor_locked = true;
+     }
+
+     if (!m->is_governor_locked) {
+	  // no CPU with cpufreq support
+	  errno = ENOENT;
+	  return -1;
+     }
+
+     return 0;
+}
+
+void cpumon_restore_governor(struct cpumon *m)
+{
+     if (!m->is_governor_locked)
+	  return;
+
+     char path[128];
+     for (int i = 0; i < m->ncpus; i++) {
+	  if (m->governors[i][0] == '\0')
+	       continue;
+	  snprintf(path, sizeof(path), CPUMON_CPUFREQ_PATH, i,
+		   "scaling_governor");
+	  write_line(path, m->governors[i]);
+     }
+     m->is_governor_locked = false;
+}
+
+/**
+ * Append a formatted annotation to a buffer if it fits completely.
+ *
+ * @return true if the annotation was appended.
+ */
+static bool append(char *buf, size_t size, size_t *len, const char *line)
+{
+     size_t n = strlen(line);
+     if (*len+n > size)
+	  return false;
+     memcpy(buf+*len, line, n);
+     *len += n;
+
+     return true;
+}
+
+size_t cpumon_poll(struct cpumon *m, uint64_t t, char *buf, size_t size)
+{
+     char path[128];
+     char line[96];
+     size_t len = 0;
+     unsigned long long ts = (unsigned long long) t;
+
+     for (int i = 0; i < m->ncpus; i++) {
+	  snprintf(path, sizeof(path), CPUMON_CPUFREQ_PATH, i,
+		   "scaling_cur_freq");
+	  long freq = read_number(path, 10);
+	  if (freq == -1 || freq == m->freq[i])
+	       continue;
+	  snprintf(line, sizeof(line), "#%llu,cpufreq,%d,%ld\n", ts, i, freq);
+	  if (append(buf, size, &len, line))
+	       m->freq[i] = freq;
+     }
+
+     long throttled = read_number(CPUMON_THROTTLED_PATH, 16);
+     if (throttled != -1 && throttled != m->throttled) {
+	  snprintf(line, sizeof(line), "#%llu,throttled,0x%lx\n", ts,
+		   throttled);
+	  if (append(buf, size, &len, line))
+	       m->throttled = throttled;
+     }
+
+     long temp = read_number(CPUMON_TEMP_PATH, 10);
+     if (temp != -1 &&
+	 (m->temp == -1 || labs(temp-m->temp) >= CPUMON_TEMP_STEP)) {
+	  snprintf(line, sizeof(line), "#%llu,temp,%.1f\n", ts, temp/1000.0);
+	  if (append(buf, size, &len, line))
+	       m->temp = temp;
+     }
+
+     return len;
+}
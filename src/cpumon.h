@@ -0,0 +1,103 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef CPUMON_H
+#define CPUMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of CPUs monitored. */
+#define CPUMON_MAX_CPUS 64
+
+/* Maximum length of the name of a cpufreq governor. */
+#define CPUMON_GOVERNOR_LEN 32
+
+/* Minimum change of temperature that is annotated [1/1000 degree
+   Celsius]. */
+#define CPUMON_TEMP_STEP 1000
+
+#define CPUMON_CPUFREQ_PATH "/sys/devices/system/cpu/cpu%d/cpufreq/%s"
+#define CPUMON_TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
+/* Throttling state reported by the firmware of the Raspberry Pi (same as
+   vcgencmd get_throttled). */
+#define CPUMON_THROTTLED_PATH \
+     "/sys/devices/platform/soc/soc:firmware/get_throttled"
+
+/**
+ * Monitor of CPU frequencies, throttling state, and temperature. Values
+ * that are not available on a system (e.g., the throttling state on other
+ * platforms than the Raspberry Pi) are not monitored.
+ */
+struct cpumon {
+     int ncpus;
+     /* Last annotated values; -1 if not annotated yet or not available. */
+     long freq[CPUMON_MAX_CPUS];
+     long temp;
+     long throttled;
+     /* Governors before locking them to performance. */
+     bool is_governor_locked;
+     char governors[CPUMON_MAX_CPUS][CPUMON_GOVERNOR_LEN];
+};
+
+/**
+ * Initialize a CPU monitor.
+ *
+ * @param m the monitor
+ */
+void cpumon_init(struct cpumon *m);
+
+/**
+ * Set the cpufreq governor of all CPUs to performance, so the CPU clock
+ * does not change during the measurement (except for throttling).
+ *
+ * @param m the monitor
+ * @return 0 on success, or -1 in case of an error (errno is set).
+ */
+int cpumon_lock_governor(struct cpumon *m);
+
+/**
+ * Restore the cpufreq governors replaced by cpumon_lock_governor().
+ *
+ * @param m the monitor
+ */
+void cpumon_restore_governor(struct cpumon *m);
+
+/**
+ * Read the current CPU frequencies, throttling state, and temperature, and
+ * format an annotation line for each value that has changed since the last
+ * call.
+ *
+ * Format of annotation lines: comma-separated values starting with '#'
+ * #timestamp [nanoseconds],cpufreq,CPU,frequency [kHz]
+ * #timestamp [nanoseconds],throttled,throttling state (hexadecimal)
+ * #timestamp [nanoseconds],temp,temperature [degree Celsius]
+ *
+ * @param m the monitor
+ * @param t timestamp of the annotations
+ * @param buf buffer for the annotation lines
+ * @param size size of the buffer
+ * @return length of the annotation lines; lines not fitting into the buffer
+ * are annotated with the next call.
+ */
+size_t cpumon_poll(struct cpumon *m, uint64_t t, char *buf, size_t size);
+
+#endif
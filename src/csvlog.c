@@ -0,0 +1,316 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "csvlog.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int csvlog_map_open(const char *path, struct csvlog_map *map)
+{
+     int fd = open(path, O_RDONLY);
+     if (fd == -1)
+	  return -1;
+
+     struct stat st;
+     if (fstat(fd, &st) == -1) {
+	  close(fd);
+	  return -1;
+     }
+
+     map->size = st.st_size;
+     if (map->size == 0) {
+	  /* Empty files cannot be mapped. */
+	  map->data = NULL;
+	  close(fd);
+	  return 0;
+     }
+     
+     void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (data == MAP_FAILED)
+	  return -1;
+
+     /* Log files are mostly scanned front to back. */
+     madvise(data, map->size, MADV_SEQUENTIAL);
+     map->data = data;
+     
+     return 0;
+}
+
+void csvlog_map_close(struct csvlog_map *map)
+{
+     if (map->data != NULL)
+	  munmap((void *) map->data, map->size);
+     map->data = NULL;
+     map->size = 0;
+}
+
+const char *csvlog_next_line(const char *p, const char *end)
+{
+     const char *nl = memchr(p, '\n', end-p);
+
+     return (nl == NULL ? end : nl+1);
+}
+
+/**
+ * Parse an unsigned decimal number.
+ *
+ * @param p position of the first digit; on return, points to the first
+ * character after the number
+ * @param end end of the buffer
+ * @param value the parsed number
+ * @return 0 on success, or -1 if there is no digit at position p.
+ */
+static int parse_uint(const char **p, const char *end, uint64_t *value)
+{
+     const char *s = *p;
+     uint64_t v = 0;
+     
+     while (s < end && *s >= '0' && *s <= '9') {
+	  v = 10*v + (*s-'0');
+	  s++;
+     }
+
+     if (s == *p)
+	  return -1;
+     
+     *value = v;
+     *p = s;
+
+     return 0;
+}
+
+/**
+ * Parse a field of a CSV line holding an unsigned decimal number.
+ *
+ * @param p position of the field; on return, points to the first
+ * character after the field separator (if any)
+ * @param end end of the buffer
+ * @param value the parsed number
+ * @param last true if this is the last field of the line
+ * @return 0 on success, or -1 if the field is not a number.
+ */
+static int parse_field(const char **p, const char *end, uint64_t *value,
+		       bool *last)
+{
+     if (parse_uint(p, end, value) == -1)
+	  return -1;
+
+     /* Accept CRLF line endings. */
+     if (*p < end && **p == '\r')
+	  (*p)++;
+     if (*p == end || **p == '\n') {
+	  *last = true;
+	  return 0;
+     }
+
+     if (**p != ',')
+	  return -1;
+     (*p)++;
+     *last = false;
+     
+     return 0;
+}
+
+int csvlog_parse_line(const char **p, const char *end, struct log_record *rec)
+{
+     const char *s = *p;
+     uint64_t timestamp, epoch, value;
+     uint64_t count = 1;
+     bool last;
+     int status = -1;
+
+     if (parse_field(&s, end, &timestamp, &last) == 0 && !last &&
+	 parse_field(&s, end, &epoch, &last) == 0 && !last &&
+	 parse_field(&s, end, &value, &last) == 0 && value <= UINT16_MAX &&
+	 (last || (parse_field(&s, end, &count, &last) == 0 && last)) &&
+	 count >= 1 && count <= UINT32_MAX) {
+	  rec->timestamp = timestamp;
+	  rec->epoch = epoch;
+	  rec->value = value;
+	  rec->count = count;
+	  status = 0;
+     }
+
+     *p = csvlog_next_line(s, end);
+     
+     return status;
+}
+
+int csvlog_write_sample(FILE *f, uint64_t t, uint64_t epoch, uint16_t value)
+{
+     return fprintf(f, "%llu,%llu,%d\n", (unsigned long long) t,
+		    (unsigned long long) epoch, value);
+}
+
+int csvlog_write_run(FILE *f, uint64_t t, uint64_t epoch, uint16_t value,
+		     uint32_t count)
+{
+     return fprintf(f, "%llu,%llu,%d,%u\n", (unsigned long long) t,
+		    (unsigned long long) epoch, value, count);
+}
+
+bool csvlog_is_tick_log(const struct csvlog_map *map)
+{
+     size_t len = strlen(CSVLOG_TICK_MAGIC);
+
+     return (map->size >= len &&
+	     memcmp(map->data, CSVLOG_TICK_MAGIC, len) == 0);
+}
+
+void csvlog_tick_init(struct csvlog_tick_state *s)
+{
+     s->has_schedule = false;
+     s->has_last = false;
+     s->last = 0;
+     s->step = 1;
+}
+
+/**
+ * Start the schedule of an epoch.
+ */
+static int tick_start(struct csvlog_tick_state *s, uint64_t epoch,
+		      uint64_t t0, uint64_t frequency)
+{
+     if (schedule_init(&s->sched,
+		       (double) frequency/SCHEDULE_FREQUENCY_SCALE) == -1)
+	  return -1;
+     schedule_start(&s->sched, t0);
+     s->has_schedule = true;
+     s->epoch = epoch;
+     s->has_last = false;
+     s->step = 1;
+     
+     return 0;
+}
+
+/**
+ * Update the last tick after a tick record.
+ */
+static void tick_update(struct csvlog_tick_state *s, uint64_t tick)
+{
+     if (s->has_last)
+	  s->step = tick-s->last;
+     s->last = tick;
+     s->has_last = true;
+}
+
+int csvlog_parse_tick_line(const char **p, const char *end,
+			   struct csvlog_tick_state *s, struct log_record *rec)
+{
+     const char *s0 = *p;
+     const char *l = s0;
+     uint64_t fields[4];
+     unsigned int n = 0;
+     bool last = false;
+     int status = -1;
+
+     if (l < end && *l == 'E') {
+	  // Start of schedule
+	  l++;
+	  if (l < end && *l == ',') {
+	       l++;
+	       while (n < 3 && parse_field(&l, end, &fields[n], &last) == 0) {
+		    n++;
+		    if (last)
+			 break;
+	       }
+	  }
+	  if (n == 3 && last &&
+	      tick_start(s, fields[0], fields[1], fields[2]) == 0)
+	       status = 1;
+	  *p = csvlog_next_line(l, end);
+	  return status;
+     }
+     
+     if (l == end || *l < '0' || *l > '9') {
+	  // Comment or annotation
+	  *p = csvlog_next_line(l, end);
+	  return 1;
+     }
+
+     while (n < 3 && parse_field(&l, end, &fields[n], &last) == 0) {
+	  n++;
+	  if (last)
+	       break;
+     }
+
+     if (n == 0 || !last || fields[n-1] > UINT16_MAX) {
+	  n = 0;
+     } else if (n == 3) {
+	  rec->timestamp = fields[0];
+	  rec->epoch = fields[1];
+	  rec->value = fields[2];
+	  rec->count = 1;
+	  s->has_last = false;
+	  status = 0;
+     } else if (s->has_schedule && (n == 2 || s->has_last)) {
+	  uint64_t tick = (n == 2 ? fields[0] : s->last+s->step);
+	  tick_update(s, tick);
+	  rec->timestamp = schedule_deadline(&s->sched, tick);
+	  rec->epoch = s->epoch;
+	  rec->value = fields[n-1];
+	  rec->count = 1;
+	  status = 0;
+     }
+
+     *p = csvlog_next_line(l, end);
+     
+     return status;
+}
+
+int csvlog_write_schedule(FILE *f, struct csvlog_tick_state *s,
+			  uint64_t epoch, uint64_t t0, uint64_t frequency)
+{
+     if (tick_start(s, epoch, t0, frequency) == -1)
+	  s->has_schedule = false;
+     
+     return fprintf(f, "E,%llu,%llu,%llu\n", (unsigned long long) epoch,
+		    (unsigned long long) t0, (unsigned long long) frequency);
+}
+
+int csvlog_write_tick(FILE *f, struct csvlog_tick_state *s, uint64_t t,
+		      uint64_t epoch, uint64_t tick, uint16_t value,
+		      uint64_t tolerance)
+{
+     if (!s->has_schedule || epoch != s->epoch) {
+	  s->has_last = false;
+	  return csvlog_write_sample(f, t, epoch, value);
+     }
+     
+     uint64_t deadline = schedule_deadline(&s->sched, tick);
+     uint64_t deviation = (t > deadline ? t-deadline : deadline-t);
+     if (deviation > tolerance) {
+	  s->has_last = false;
+	  return csvlog_write_sample(f, t, epoch, value);
+     }
+
+     if (s->has_last && tick-s->last == s->step) {
+	  s->last = tick;
+	  return fprintf(f, "%d\n", value);
+     }
+
+     tick_update(s, tick);
+     return fprintf(f, "%llu,%d\n", (unsigned long long) tick, value);
+}
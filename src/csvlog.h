@@ -0,0 +1,209 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef CSVLOG_H
+#define CSVLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "timing.h"
+
+/* First line of a tick log. */
+#define CSVLOG_TICK_MAGIC "#LEMTICK1"
+
+/**
+ * A sample as recorded in a CSV log file. With change-only logging, a
+ * record represents a run of samples with identical value starting at the
+ * given timestamp.
+ */
+struct log_record {
+     uint64_t timestamp;
+     uint64_t epoch;
+     uint16_t value;
+     uint32_t count;
+};
+
+/**
+ * State of reading or writing a tick log. In a tick log, samples are
+ * identified by their tick of the sampling schedule of their epoch.
+ */
+struct csvlog_tick_state {
+     bool has_schedule;
+     uint64_t epoch;
+     struct schedule sched;
+     /* Tick of the last tick record and the difference to the tick record
+	before (only if has_last). */
+     bool has_last;
+     uint64_t last;
+     uint64_t step;
+};
+
+/**
+ * A log file mapped into memory.
+ */
+struct csvlog_map {
+     const char *data;
+     size_t size;
+};
+
+/**
+ * Map a log file into memory (read-only).
+ *
+ * @param path path of the log file
+ * @param map the mapping
+ * @return 0 on success, or -1 in case of an error (errno is set).
+ */
+int csvlog_map_open(const char *path, struct csvlog_map *map);
+
+/**
+ * Unmap a log file.
+ *
+ * @param map the mapping
+ */
+void csvlog_map_close(struct csvlog_map *map);
+
+/**
+ * Find the beginning of the next line.
+ *
+ * @param p position within the current line
+ * @param end end of the buffer
+ * @return pointer to the first character of the next line, or end if
+ * there is no next line.
+ */
+const char *csvlog_next_line(const char *p, const char *end);
+
+/**
+ * Parse a line of a log file.
+ *
+ * Format: comma-separated values
+ * timestamp [nanoseconds], epoch, value [, number of samples]
+ * The number of samples (change-only logging) defaults to 1.
+ *
+ * @param p pointer to the beginning of the line; on return, points to the
+ * beginning of the next line
+ * @param end end of the buffer
+ * @param rec the parsed record
+ * @return 0 on success, or -1 if the line does not contain a valid record.
+ */
+int csvlog_parse_line(const char **p, const char *end, struct log_record *rec);
+
+/**
+ * Check whether a log file is a tick log.
+ *
+ * @param map the mapped log file
+ * @return true if the log file is a tick log.
+ */
+bool csvlog_is_tick_log(const struct csvlog_map *map);
+
+/**
+ * Initialize the state of reading or writing a tick log.
+ *
+ * @param s the state
+ */
+void csvlog_tick_init(struct csvlog_tick_state *s);
+
+/**
+ * Parse a line of a tick log. The lines of a tick log must be parsed in
+ * order.
+ *
+ * Format of lines:
+ * E, epoch, time of tick 0 [nanoseconds], sampling frequency [1/1000 Hz]
+ * (start of the sampling schedule of an epoch)
+ * value (sample at the tick of the last sample plus the last tick step)
+ * tick, value (sample at the given tick)
+ * timestamp [nanoseconds], epoch, value (sample deviating from schedule)
+ * Other lines, e.g., lines starting with '#', are ignored.
+ *
+ * @param p pointer to the beginning of the line; on return, points to the
+ * beginning of the next line
+ * @param end end of the buffer
+ * @param s the state of reading the tick log
+ * @param rec the parsed record; the timestamp of samples identified by
+ * their tick is the scheduled sampling time
+ * @return 0 if the line contains a sample, 1 if the line contains no
+ * sample, or -1 if the line is not valid.
+ */
+int csvlog_parse_tick_line(const char **p, const char *end,
+			   struct csvlog_tick_state *s, struct log_record *rec);
+
+/**
+ * Write the start of the sampling schedule of an epoch to a tick log.
+ *
+ * @param f output file
+ * @param s the state of writing the tick log
+ * @param epoch epoch
+ * @param t0 time of tick 0
+ * @param frequency sampling frequency in 1/SCHEDULE_FREQUENCY_SCALE Hz
+ * @return number of bytes written, or a negative value in case of an error.
+ */
+int csvlog_write_schedule(FILE *f, struct csvlog_tick_state *s,
+			  uint64_t epoch, uint64_t t0, uint64_t frequency);
+
+/**
+ * Write a sample to a tick log. The sample is identified by its tick if
+ * it belongs to the epoch of the current schedule and its timestamp
+ * deviates from its scheduled sampling time by at most the given
+ * tolerance; otherwise, it is written with its timestamp.
+ *
+ * @param f output file
+ * @param s the state of writing the tick log
+ * @param t timestamp of sample
+ * @param epoch epoch
+ * @param tick tick of the sample
+ * @param value sample value
+ * @param tolerance tolerance [nanoseconds]
+ * @return number of bytes written, or a negative value in case of an error.
+ */
+int csvlog_write_tick(FILE *f, struct csvlog_tick_state *s, uint64_t t,
+		      uint64_t epoch, uint64_t tick, uint16_t value,
+		      uint64_t tolerance);
+
+/**
+ * Write a timestamped sample as CSV to a log file.
+ *
+ * Format: comma-separated values
+ * timestamp [nanoseconds], epoch, value
+ *
+ * @param f output file
+ * @param t timestamp of sample
+ * @param epoch epoch
+ * @param value sample value
+ * @return number of bytes written, or a negative value in case of an error.
+ */
+int csvlog_write_sample(FILE *f, uint64_t t, uint64_t epoch, uint16_t value);
+
+/**
+ * Write a run of samples with identical ADC count as CSV to a log file.
+ *
+ * Format: comma-separated values
+ * timestamp of first sample [nanoseconds], epoch, value, number of samples
+ *
+ * @param f output file
+ * @param t timestamp of first sample of run
+ * @param epoch epoch
+ * @param value sample value
+ * @param count number of samples
+ * @return number of bytes written, or a negative value in case of an error.
+ */
+int csvlog_write_run(FILE *f, uint64_t t, uint64_t epoch, uint16_t value,
+		     uint32_t count);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "energy.h"
+
+#include <math.h>
+
+double adc_to_voltage(uint16_t count)
+{
+     return ADC_FULL_SCALE_VOLTAGE*count/ADC_MAX_COUNT;
+}
+
+double discharge_energy(uint16_t count_upper, uint16_t count_lower)
+{
+     double vupper = adc_to_voltage(count_upper);
+     double vlower = adc_to_voltage(count_lower);
+
+     return 0.5*CAPACITANCE*(vupper*vupper-vlower*vlower);
+}
+
+double charge_time(uint16_t count_from, uint16_t count_to)
+{
+     if (count_from >= count_to)
+	  return 0.0;
+
+     double vfrom = adc_to_voltage(count_from);
+     double vto = adc_to_voltage(count_to);
+     if (vto >= SUPPLY_VOLTAGE)
+	  return HUGE_VAL;
+     
+     return CHARGE_RESISTANCE*CAPACITANCE*
+	  log((SUPPLY_VOLTAGE-vfrom)/(SUPPLY_VOLTAGE-vto));
+}
@@ -0,0 +1,68 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+
+/* Capacity of the supply capacitor in Farad (10000 uF). */
+#define CAPACITANCE 0.01
+
+/* The ADC reference is 2.5 V and the capacitor voltage is divided by 2
+   before sampling. Therefore, the maximum ADC count corresponds to 5.0 V. */
+#define ADC_FULL_SCALE_VOLTAGE 5.0
+#define ADC_MAX_COUNT 4095
+
+/* The capacitor is charged from the 3.3 V rail of the Raspberry Pi via a
+   160 Ohm resistor (time constant 1.6 s). */
+#define SUPPLY_VOLTAGE 3.3
+#define CHARGE_RESISTANCE 160.0
+
+/**
+ * Translate an ADC count to the voltage of the supply capacitor.
+ *
+ * @param count ADC count
+ * @return voltage in Volt
+ */
+double adc_to_voltage(uint16_t count);
+
+/**
+ * Calculate the energy released by the supply capacitor while discharging
+ * from one voltage to another one (E = 0.5*C*(V_upper^2-V_lower^2)).
+ *
+ * @param count_upper ADC count at the beginning of the discharging interval
+ * @param count_lower ADC count at the end of the discharging interval
+ * @return energy in Joule
+ */
+double discharge_energy(uint16_t count_upper, uint16_t count_lower);
+
+/**
+ * Predict the time to charge the supply capacitor from one voltage to
+ * another one (V(t) = V_s-(V_s-V_0)*exp(-t/(R*C))). A load powered while
+ * charging slows down charging, so the prediction is a lower bound.
+ *
+ * @param count_from ADC count at the beginning of the charging interval
+ * @param count_to ADC count at the end of the charging interval
+ * @return time in seconds, 0 if count_from >= count_to, or HUGE_VAL if
+ * count_to cannot be reached.
+ */
+double charge_time(uint16_t count_from, uint16_t count_to);
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "epochstats.h"
+#include "energy.h"
+#include "leakage.h"
+
+void epoch_stats_init(struct epoch_stats *s, uint64_t epoch,
+		      const struct leakage_model *leakage)
+{
+     s->epoch = epoch;
+     s->samples = 0;
+     s->t_min = UINT64_MAX;
+     s->t_max = 0;
+     s->value_min = UINT16_MAX;
+     s->value_max = 0;
+     s->t_first = 0;
+     linfit_init(&s->fit);
+     s->t_last = 0;
+     s->v2_last = 0.0;
+     s->run_count = 0;
+     s->leakage = leakage;
+     s->p_leak_last = 0.0;
+     s->leakage_energy = 0.0;
+}
+
+void epoch_stats_end_run(struct epoch_stats *s, uint64_t t_next)
+{
+     if (s->run_count < 2 || t_next <= s->t_last)
+	  return;
+
+     /* The samples of the run are taken every (t_next-t_last)/run_count;
+	the first sample of the run has already been added. */
+     double period = (t_next-s->t_last)/1000000000.0/s->run_count;
+     uint64_t t_end = s->t_last +
+	  (uint64_t) ((double) (t_next-s->t_last)*(s->run_count-1)/
+		      s->run_count);
+     linfit_add_run(&s->fit,
+		    ((int64_t) (s->t_last-s->t_first))/1000000000.0 + period,
+		    period, s->run_count-1, s->v2_last);
+     if (t_end > s->t_max)
+	  s->t_max = t_end;
+
+     s->leakage_energy += s->p_leak_last*(t_end-s->t_last)/1000000000.0;
+     s->t_last = t_end;
+     s->run_count = 1;
+}
+
+void epoch_stats_add(struct epoch_stats *s, const struct log_record *rec)
+{
+     if (s->samples > 0)
+	  epoch_stats_end_run(s, rec->timestamp);
+     
+     if (s->samples == 0)
+	  s->t_first = rec->timestamp;
+     s->samples += rec->count;
+
+     if (rec->timestamp < s->t_min)
+	  s->t_min = rec->timestamp;
+     if (rec->timestamp > s->t_max)
+	  s->t_max = rec->timestamp;
+     
+     if (rec->value < s->value_min)
+	  s->value_min = rec->value;
+     if (rec->value > s->value_max)
+	  s->value_max = rec->value;
+
+     double v = adc_to_voltage(rec->value);
+     double v2 = v*v;
+     linfit_add(&s->fit, ((int64_t) (rec->timestamp-s->t_first))/1000000000.0,
+		v2);
+
+     if (s->leakage != NULL) {
+	  double p_leak = leakage_power(s->leakage, v2);
+	  if (s->samples > rec->count)
+	       s->leakage_energy += 0.5*(s->p_leak_last+p_leak)*
+		    ((int64_t) (rec->timestamp-s->t_last))/1000000000.0;
+	  s->p_leak_last = p_leak;
+     }
+     s->t_last = rec->timestamp;
+     s->v2_last = v2;
+     s->run_count = rec->count;
+}
+
+double epoch_stats_duration(const struct epoch_stats *s)
+{
+     if (s->samples == 0)
+	  return 0.0;
+     
+     return (s->t_max-s->t_min)/1000000000.0;
+}
+
+double epoch_stats_energy(const struct epoch_stats *s)
+{
+     if (s->samples == 0)
+	  return 0.0;
+
+     return discharge_energy(s->value_max, s->value_min);
+}
+
+double epoch_stats_power(const struct epoch_stats *s)
+{
+     double t = epoch_stats_duration(s);
+
+     if (t == 0.0)
+	  return 0.0;
+
+     return epoch_stats_energy(s)/t;
+}
+
+double epoch_stats_leakage_energy(const struct epoch_stats *s)
+{
+     return s->leakage_energy;
+}
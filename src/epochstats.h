@@ -0,0 +1,129 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef EPOCHSTATS_H
+#define EPOCHSTATS_H
+
+#include <stdint.h>
+#include "csvlog.h"
+#include "linfit.h"
+
+struct leakage_model;
+
+/**
+ * Statistics of the samples of one epoch (discharging cycle) within a
+ * range of ADC counts.
+ */
+struct epoch_stats {
+     uint64_t epoch;
+     uint64_t samples;
+
+     uint64_t t_min;
+     uint64_t t_max;
+
+     uint16_t value_min;
+     uint16_t value_max;
+
+     /* Least-squares fit of V^2 over time since the first sample. */
+     uint64_t t_first;
+     struct linfit fit;
+
+     /* Last sample added and the length of its run (change-only
+	logging). */
+     uint64_t t_last;
+     double v2_last;
+     uint32_t run_count;
+
+     /* Leakage model, or NULL, and integral of the leakage power over
+	time [J] (trapezoidal rule). */
+     const struct leakage_model *leakage;
+     double p_leak_last;
+     double leakage_energy;
+};
+
+/**
+ * Initialize statistics of an epoch without samples.
+ *
+ * @param s the statistics
+ * @param epoch the epoch
+ * @param leakage leakage model to integrate over the samples, or NULL
+ */
+void epoch_stats_init(struct epoch_stats *s, uint64_t epoch,
+		      const struct leakage_model *leakage);
+
+/**
+ * Add a sample to the statistics of an epoch. A run of samples with
+ * identical value (change-only logging) is counted as rec->count samples.
+ * Since the sampling interval is not logged, the samples of the run after
+ * the first are only added to the fit and the leakage integral when the
+ * time of the next sample is known (see epoch_stats_end_run()); they are
+ * evenly spaced between the start of the run and the next sample, as in
+ * a log of all samples.
+ *
+ * @param s the statistics
+ * @param rec the sample
+ */
+void epoch_stats_add(struct epoch_stats *s, const struct log_record *rec);
+
+/**
+ * Complete the run of the last sample added, given the time of the next
+ * sample of the log. Called by epoch_stats_add(); must be called before a
+ * sample is not added to these statistics, e.g., since it belongs to
+ * another time window or is filtered.
+ *
+ * @param s the statistics
+ * @param t_next timestamp of the next sample
+ */
+void epoch_stats_end_run(struct epoch_stats *s, uint64_t t_next);
+
+/**
+ * Time between first and last sample.
+ *
+ * @param s the statistics
+ * @return duration in seconds
+ */
+double epoch_stats_duration(const struct epoch_stats *s);
+
+/**
+ * Energy released by the supply capacitor between the maximum and minimum
+ * voltage sampled.
+ *
+ * @param s the statistics
+ * @return energy in Joule
+ */
+double epoch_stats_energy(const struct epoch_stats *s);
+
+/**
+ * Average power consumption, i.e., energy divided by duration.
+ *
+ * @param s the statistics
+ * @return power in Watt, or 0 if the duration is zero.
+ */
+double epoch_stats_power(const struct epoch_stats *s);
+
+/**
+ * Leakage energy between first and last sample, i.e., the integral of the
+ * leakage power of the model given to epoch_stats_init().
+ *
+ * @param s the statistics
+ * @return energy in Joule, or 0 without leakage model.
+ */
+double epoch_stats_leakage_energy(const struct epoch_stats *s);
+
+#endif
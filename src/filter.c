@@ -0,0 +1,38 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "filter.h"
+
+void record_filter_init(struct record_filter *f)
+{
+     f->epoch_min = 0;
+     f->epoch_max = UINT64_MAX;
+     f->t_min = 0;
+     f->t_max = UINT64_MAX;
+     f->value_min = 0;
+     f->value_max = UINT16_MAX;
+}
+
+bool record_filter_match(const struct record_filter *f,
+			 const struct log_record *rec)
+{
+     return (rec->epoch >= f->epoch_min && rec->epoch <= f->epoch_max &&
+	     rec->timestamp >= f->t_min && rec->timestamp <= f->t_max &&
+	     rec->value >= f->value_min && rec->value <= f->value_max);
+}
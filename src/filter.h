@@ -0,0 +1,59 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csvlog.h"
+
+/**
+ * Filter selecting records within (inclusive) ranges of epochs, timestamps,
+ * and ADC counts.
+ */
+struct record_filter {
+     uint64_t epoch_min;
+     uint64_t epoch_max;
+
+     uint64_t t_min;
+     uint64_t t_max;
+
+     uint16_t value_min;
+     uint16_t value_max;
+};
+
+/**
+ * Initialize a filter accepting all records.
+ *
+ * @param f the filter
+ */
+void record_filter_init(struct record_filter *f);
+
+/**
+ * Check whether a record passes a filter.
+ *
+ * @param f the filter
+ * @param rec the record
+ * @return true if the record passes the filter.
+ */
+bool record_filter_match(const struct record_filter *f,
+			 const struct log_record *rec);
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "flightrec.h"
+
+void flightrec_init(struct flightrec *fr)
+{
+     fr->active = 0;
+     fr->head = 0;
+     fr->frozen = -1;
+     fr->frozen_head = 0;
+     fr->dropped = 0;
+     fr->dumps = 0;
+}
+
+void flightrec_write_header(FILE *f)
+{
+     fprintf(f, "dump,t_scheduled,t_wakeup,t_sample,t_end,lateness,"
+	     "ring_fill,state,value\n");
+}
+
+bool flightrec_dump(struct flightrec *fr, FILE *f)
+{
+     int frozen = __atomic_load_n(&fr->frozen, __ATOMIC_ACQUIRE);
+     if (frozen == -1)
+	  return false;
+
+     const struct flightrec_entry *buffer = fr->buffers[frozen];
+     uint32_t head = fr->frozen_head;
+     uint32_t n = (head < FLIGHTREC_SIZE ? head : FLIGHTREC_SIZE);
+     fr->dumps++;
+     for (uint32_t i = head-n; i != head; i++) {
+	  const struct flightrec_entry *e = &buffer[i & (FLIGHTREC_SIZE-1)];
+	  long long lateness = (long long) (e->t_wakeup-e->t_scheduled);
+	  fprintf(f, "%u,%llu,%llu,%llu,%llu,%lld,%u,%u,%d\n", fr->dumps,
+		  (unsigned long long) e->t_scheduled,
+		  (unsigned long long) e->t_wakeup,
+		  (unsigned long long) e->t_sample,
+		  (unsigned long long) e->t_end, lateness, e->ring_fill,
+		  e->state, e->value);
+     }
+     fflush(f);
+
+     __atomic_store_n(&fr->frozen, -1, __ATOMIC_RELEASE);
+
+     return true;
+}
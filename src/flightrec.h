@@ -0,0 +1,146 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of iterations of the sampling loop kept in a trace. Must be a
+   power of 2. */
+#define FLIGHTREC_SIZE 1024
+
+/**
+ * One iteration of the sampling loop. Times are in nanoseconds.
+ */
+struct flightrec_entry {
+     /* Scheduled sampling time */
+     uint64_t t_scheduled;
+     /* Wakeup of the sampling thread, i.e., start of the SPI transfer */
+     uint64_t t_wakeup;
+     /* End of the SPI transfer (timestamp of the sample) */
+     uint64_t t_sample;
+     /* End of the iteration before going to sleep */
+     uint64_t t_end;
+     /* Fill level of the ring after putting the sample (0 if no sample
+	was put) */
+     uint32_t ring_fill;
+     /* State of the sampling loop */
+     uint16_t state;
+     /* ADC count */
+     int16_t value;
+};
+
+/**
+ * Flight recorder of the last FLIGHTREC_SIZE iterations of the sampling
+ * loop.
+ *
+ * The sampling thread writes entries into the active one of two trace
+ * buffers without locks or system calls. When an iteration is late, the
+ * sampling thread freezes the active buffer and continues with the other
+ * one; a dumping thread writes the frozen buffer to a file and releases it.
+ * If the sampling thread is late again before the frozen buffer has been
+ * dumped, the trace is not frozen and the trigger is counted as dropped.
+ */
+struct flightrec {
+     struct flightrec_entry buffers[2][FLIGHTREC_SIZE];
+     /* Buffer written by the sampling thread, and number of entries
+	written into it. Only accessed by the sampling thread. */
+     unsigned int active;
+     uint32_t head;
+     /* Frozen buffer waiting to be dumped (-1 if none) and its number of
+	entries. Handed over from the sampling thread to the dumping thread
+	and back by atomic stores. */
+     int frozen;
+     uint32_t frozen_head;
+     /* Triggers while a buffer was waiting to be dumped. */
+     uint32_t dropped;
+     /* Number of dumps written so far. Only accessed by the dumping
+	thread. */
+     uint32_t dumps;
+};
+
+/**
+ * Initialize a flight recorder.
+ *
+ * @param fr the flight recorder
+ */
+void flightrec_init(struct flightrec *fr);
+
+/**
+ * Get the entry of the current iteration. Must only be called by the
+ * sampling thread.
+ *
+ * @param fr the flight recorder
+ * @return the entry to be filled
+ */
+static inline struct flightrec_entry *flightrec_entry(struct flightrec *fr)
+{
+     return &fr->buffers[fr->active][fr->head & (FLIGHTREC_SIZE-1)];
+}
+
+/**
+ * Complete the entry of the current iteration. Must only be called by the
+ * sampling thread.
+ *
+ * @param fr the flight recorder
+ * @param trigger true to freeze the trace including this entry for dumping
+ */
+static inline void flightrec_commit(struct flightrec *fr, bool trigger)
+{
+     fr->head++;
+     if (!trigger)
+	  return;
+
+     if (__atomic_load_n(&fr->frozen, __ATOMIC_ACQUIRE) != -1) {
+	  __atomic_store_n(&fr->dropped, fr->dropped+1, __ATOMIC_RELAXED);
+	  return;
+     }
+     fr->frozen_head = fr->head;
+     __atomic_store_n(&fr->frozen, (int) fr->active, __ATOMIC_RELEASE);
+     fr->active ^= 1;
+     fr->head = 0;
+}
+
+/**
+ * Write the frozen trace as CSV to a file and release it. Must only be
+ * called by the dumping thread.
+ *
+ * Format: comma-separated values
+ * dump number, scheduled time, wakeup time, sample time, end time [ns],
+ * lateness [ns], ring fill level, loop state, ADC count
+ * The last entry of a dump is the late iteration.
+ *
+ * @param fr the flight recorder
+ * @param f output file
+ * @return true if a trace was written, false if no trace was frozen.
+ */
+bool flightrec_dump(struct flightrec *fr, FILE *f);
+
+/**
+ * Write the CSV header line of dumps.
+ *
+ * @param f output file
+ */
+void flightrec_write_header(FILE *f);
+
+#endif
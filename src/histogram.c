@@ -0,0 +1,80 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "histogram.h"
+
+#include <math.h>
+#include <string.h>
+
+void histogram_init(struct histogram *h)
+{
+     memset(h->counts, 0, sizeof(h->counts));
+     h->max = 0;
+}
+
+uint64_t histogram_bucket_lower(unsigned int bucket)
+{
+     if (bucket < (1u << HISTOGRAM_SUB_BITS))
+	  return bucket;
+
+     unsigned int shift = (bucket >> HISTOGRAM_SUB_BITS)-1;
+     uint64_t mantissa = (bucket & ((1u << HISTOGRAM_SUB_BITS)-1)) |
+	  (1u << HISTOGRAM_SUB_BITS);
+     return mantissa << shift;
+}
+
+uint64_t histogram_bucket_upper(unsigned int bucket)
+{
+     if (bucket+1 == HISTOGRAM_BUCKETS)
+	  return UINT64_MAX;
+     
+     return histogram_bucket_lower(bucket+1)-1;
+}
+
+uint64_t histogram_count(const struct histogram *h)
+{
+     uint64_t n = 0;
+     for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	  n += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+
+     return n;
+}
+
+uint64_t histogram_quantile(const struct histogram *h, double q)
+{
+     uint64_t n = histogram_count(h);
+     if (n == 0)
+	  return 0;
+
+     uint64_t rank = (uint64_t) ceil(q*n);
+     if (rank == 0)
+	  rank = 1;
+     uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+     uint64_t cum = 0;
+     for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+	  cum += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+	  if (cum >= rank) {
+	       uint64_t upper = histogram_bucket_upper(i);
+	       return (upper < max ? upper : max);
+	  }
+     }
+
+     return max;
+}
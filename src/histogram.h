@@ -0,0 +1,115 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Each power of 2 is divided into 2^HISTOGRAM_SUB_BITS buckets, i.e., the
+   relative width of a bucket is at most 1/8. */
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_BUCKETS (64 << HISTOGRAM_SUB_BITS)
+
+/**
+ * Histogram of 64 bit values (e.g., durations in nanoseconds) with
+ * logarithmic buckets. Values are added by one thread with relaxed atomic
+ * stores, so other threads can read the histogram while it is updated.
+ */
+struct histogram {
+     uint64_t counts[HISTOGRAM_BUCKETS];
+     uint64_t max;
+};
+
+/**
+ * Initialize a histogram.
+ *
+ * @param h the histogram
+ */
+void histogram_init(struct histogram *h);
+
+/**
+ * Bucket of a value.
+ *
+ * @param v the value
+ * @return index of the bucket
+ */
+static inline unsigned int histogram_bucket(uint64_t v)
+{
+     if (v < (1u << HISTOGRAM_SUB_BITS))
+	  return v;
+
+     unsigned int shift = 63-__builtin_clzll(v)-HISTOGRAM_SUB_BITS;
+     return ((shift+1) << HISTOGRAM_SUB_BITS) +
+	  ((v >> shift) & ((1u << HISTOGRAM_SUB_BITS)-1));
+}
+
+/**
+ * Add a value to a histogram. Must only be called by one thread.
+ *
+ * @param h the histogram
+ * @param v the value
+ */
+static inline void histogram_add(struct histogram *h, uint64_t v)
+{
+     uint64_t *c = &h->counts[histogram_bucket(v)];
+     __atomic_store_n(c, *c+1, __ATOMIC_RELAXED);
+     if (v > h->max)
+	  __atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+/**
+ * Smallest value of a bucket.
+ *
+ * @param bucket index of the bucket
+ * @return smallest value
+ */
+uint64_t histogram_bucket_lower(unsigned int bucket);
+
+/**
+ * Largest value of a bucket.
+ *
+ * @param bucket index of the bucket
+ * @return largest value
+ */
+uint64_t histogram_bucket_upper(unsigned int bucket);
+
+/**
+ * Number of values of a histogram.
+ *
+ * @param h the histogram
+ * @return number of values
+ */
+uint64_t histogram_count(const struct histogram *h);
+
+/**
+ * Upper bound of a quantile: the value at or below which at least the
+ * fraction q of values lies. Since only the bucket of the quantile is
+ * known, the largest value of the bucket is returned (or the maximum
+ * value if it is smaller).
+ *
+ * @param h the histogram
+ * @param q the quantile in [0, 1]
+ * @return upper bound of the quantile, or 0 if the histogram is empty.
+ */
+uint64_t histogram_quantile(const struct histogram *h, double q);
+
+#endif
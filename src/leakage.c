@@ -0,0 +1,97 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "leakage.h"
+#include "linfit.h"
+
+#include <stdio.h>
+
+int leakage_fit(struct leakage_model *m, const struct epoch_stats *windows,
+		size_t nwindows)
+{
+     struct linfit fit;
+     linfit_init(&fit);
+     double v2_min = 0.0;
+     double v2_max = 0.0;
+
+     for (size_t i = 0; i < nwindows; i++) {
+	  const struct epoch_stats *w = &windows[i];
+	  if (w->samples < 2)
+	       continue;
+	  double v2 = w->fit.mean_y;
+	  if (fit.n == 0 || v2 < v2_min)
+	       v2_min = v2;
+	  if (fit.n == 0 || v2 > v2_max)
+	       v2_max = v2;
+	  linfit_add(&fit, v2, linfit_power(&w->fit));
+     }
+
+     if (fit.n < 2 || fit.m2_x == 0.0)
+	  return -1;
+
+     m->p0 = linfit_intercept(&fit);
+     m->g = linfit_slope(&fit);
+     m->v2_min = v2_min;
+     m->v2_max = v2_max;
+
+     return 0;
+}
+
+int leakage_load(struct leakage_model *m, const char *path)
+{
+     FILE *f = fopen(path, "r");
+     if (f == NULL)
+	  return -1;
+
+     int n = fscanf(f, "%lf,%lf,%lf,%lf", &m->p0, &m->g, &m->v2_min,
+		    &m->v2_max);
+     fclose(f);
+
+     return (n == 4 && m->v2_min <= m->v2_max ? 0 : -1);
+}
+
+int leakage_save(const struct leakage_model *m, const char *path)
+{
+     FILE *f = fopen(path, "w");
+     if (f == NULL)
+	  return -1;
+
+     fprintf(f, "%.9g,%.9g,%.9g,%.9g\n", m->p0, m->g, m->v2_min, m->v2_max);
+
+     return (fclose(f) == EOF ? -1 : 0);
+}
+
+double leakage_power(const struct leakage_model *m, double v2)
+{
+     if (v2 < m->v2_min)
+	  v2 = m->v2_min;
+     else if (v2 > m->v2_max)
+	  v2 = m->v2_max;
+     
+     double p = m->p0 + m->g*v2;
+
+     return (p < 0.0 ? 0.0 : p);
+}
+
+double leakage_compensate(double value, double leakage)
+{
+     double v = value-leakage;
+
+     return (v < 0.0 ? 0.0 : v);
+}
@@ -0,0 +1,104 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LEAKAGE_H
+#define LEAKAGE_H
+
+#include "epochstats.h"
+
+/* Default width of the time windows used for calibration (10 min). Leakage
+   power is small, so long windows are required to see a voltage drop of
+   several ADC counts. */
+#define LEAKAGE_WINDOW_NS 600000000000ull
+
+/**
+ * Model of the leakage (self-discharging) power of the supply capacitor
+ * and measurement circuit as function of the capacitor voltage:
+ * P_leak = p0 + g*V^2
+ * The constant term covers bias currents; the quadratic term covers
+ * resistive leakage (P = V^2/R). The model is not extrapolated beyond the
+ * range of V^2 it was calibrated over: outside this range, the leakage
+ * power is held at its value at the nearest end of the range. Leakage
+ * power is limited to non-negative values.
+ */
+struct leakage_model {
+     double p0;
+     double g;
+
+     /* Calibrated range of V^2 [V^2]. */
+     double v2_min;
+     double v2_max;
+};
+
+/**
+ * Fit a leakage model from windows of a no-load measurement. The power of
+ * each window (least-squares fit) is regressed on the mean V^2 of the
+ * window. The range of the mean V^2 of the windows is the calibrated
+ * range of the model.
+ *
+ * @param m the model
+ * @param windows statistics of the windows
+ * @param nwindows number of windows
+ * @return 0 on success, or -1 if there are less than two windows with
+ * distinct voltages.
+ */
+int leakage_fit(struct leakage_model *m, const struct epoch_stats *windows,
+		size_t nwindows);
+
+/**
+ * Load a leakage model.
+ *
+ * @param m the model
+ * @param path path of the model file
+ * @return 0 on success, or -1 in case of an error or invalid model file.
+ */
+int leakage_load(struct leakage_model *m, const char *path);
+
+/**
+ * Save a leakage model.
+ *
+ * Format: comma-separated values p0 [W], g [W/V^2], minimum V^2 [V^2],
+ * maximum V^2 [V^2] of the calibrated range
+ *
+ * @param m the model
+ * @param path path of the model file
+ * @return 0 on success, or -1 in case of an error.
+ */
+int leakage_save(const struct leakage_model *m, const char *path);
+
+/**
+ * Leakage power at a certain voltage. Voltages outside the calibrated
+ * range are limited to the range.
+ *
+ * @param m the model
+ * @param v2 squared capacitor voltage [V^2]
+ * @return leakage power [W] (non-negative)
+ */
+double leakage_power(const struct leakage_model *m, double v2);
+
+/**
+ * Subtract leakage from a measured energy or power.
+ *
+ * @param value measured energy [J] or power [W]
+ * @param leakage leakage energy [J] or power [W]
+ * @return compensated energy or power (non-negative)
+ */
+double leakage_compensate(double value, double leakage);
+
+#endif
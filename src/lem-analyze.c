@@ -0,0 +1,484 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "csvlog.h"
+#include "epochstats.h"
+#include "leakage.h"
+#include "workpool.h"
+
+/* Number of chunks per worker thread when searching for epoch boundaries.
+   More chunks than workers allow for balancing the load by work stealing. */
+#define CHUNKS_PER_WORKER 4
+
+/**
+ * Position in the log file where a new epoch starts.
+ */
+struct boundary {
+     const char *pos;
+     uint64_t epoch;
+};
+
+/**
+ * Epoch boundaries found in a chunk of the log file. 
+ */
+struct chunk {
+     const char *begin;
+     const char *end;
+     
+     struct boundary *boundaries;
+     size_t nboundaries;
+     size_t capacity;
+};
+
+/**
+ * Statistics of a time window within an epoch.
+ */
+struct window {
+     uint64_t start;
+     struct epoch_stats stats;
+};
+
+/**
+ * Consecutive lines of the log file belonging to the same epoch. 
+ */
+struct segment {
+     const char *begin;
+     const char *end;
+
+     struct epoch_stats stats;
+
+     struct window *windows;
+     size_t nwindows;
+     size_t capacity;
+};
+
+struct analysis {
+     struct chunk *chunks;
+     size_t nchunks;
+
+     struct segment *segments;
+     size_t nsegments;
+
+     uint16_t value_lower;
+     uint16_t value_upper;
+
+     /* Width of time windows in nanoseconds (0: no windows). */
+     uint64_t window_ns;
+
+     /* Leakage model integrated over the samples, or NULL. */
+     const struct leakage_model *leakage;
+};
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-j THREADS] [-l LOWER_THRESHOLD] "
+	     "[-u UPPER_THRESHOLD] [-w WINDOW_SECONDS] [-c LEAKAGE_MODEL] "
+	     "LOGFILE\n", appl);
+     fprintf(stderr, "%s -L LEAKAGE_MODEL [-j THREADS] [-w WINDOW_SECONDS] "
+	     "NO_LOAD_LOGFILE\n", appl);
+}
+
+/**
+ * Add an epoch boundary to a chunk.
+ */
+void add_boundary(struct chunk *c, const char *pos, uint64_t epoch)
+{
+     if (c->nboundaries == c->capacity) {
+	  c->capacity = (c->capacity == 0 ? 16 : 2*c->capacity);
+	  c->boundaries = realloc(c->boundaries,
+				  c->capacity*sizeof(struct boundary));
+	  if (c->boundaries == NULL) {
+	       perror("Could not allocate memory");
+	       exit(-1);
+	  }
+     }
+
+     c->boundaries[c->nboundaries].pos = pos;
+     c->boundaries[c->nboundaries].epoch = epoch;
+     c->nboundaries++;
+}
+
+/**
+ * Task searching a chunk of the log file for epoch boundaries.
+ */
+void find_boundaries(void *ctx, size_t task)
+{
+     struct analysis *a = (struct analysis *) ctx;
+     struct chunk *c = &a->chunks[task];
+     const char *p = c->begin;
+     bool first = true;
+     uint64_t epoch = 0;
+
+     while (p < c->end) {
+	  const char *line = p;
+	  struct log_record rec;
+	  if (csvlog_parse_line(&p, c->end, &rec) == -1)
+	       continue;
+	  if (first || rec.epoch != epoch) {
+	       add_boundary(c, line, rec.epoch);
+	       epoch = rec.epoch;
+	       first = false;
+	  }
+     }
+}
+
+/**
+ * Add a sample to the time window of a segment containing the sample.
+ * Windows are aligned to the first sample of the segment.
+ */
+void add_to_window(struct analysis *a, struct segment *s,
+		   const struct log_record *rec)
+{
+     uint64_t start = s->stats.t_first +
+	  (rec->timestamp-s->stats.t_first)/a->window_ns*a->window_ns;
+     
+     if (s->nwindows == 0 || s->windows[s->nwindows-1].start != start) {
+	  if (s->nwindows > 0)
+	       epoch_stats_end_run(&s->windows[s->nwindows-1].stats,
+				   rec->timestamp);
+	  if (s->nwindows == s->capacity) {
+	       s->capacity = (s->capacity == 0 ? 16 : 2*s->capacity);
+	       s->windows = realloc(s->windows,
+				    s->capacity*sizeof(struct window));
+	       if (s->windows == NULL) {
+		    perror("Could not allocate memory");
+		    exit(-1);
+	       }
+	  }
+	  struct window *w = &s->windows[s->nwindows++];
+	  w->start = start;
+	  epoch_stats_init(&w->stats, rec->epoch, a->leakage);
+     }
+
+     epoch_stats_add(&s->windows[s->nwindows-1].stats, rec);
+}
+
+/**
+ * Task calculating the statistics of a segment.
+ */
+void analyze_segment(void *ctx, size_t task)
+{
+     struct analysis *a = (struct analysis *) ctx;
+     struct segment *s = &a->segments[task];
+     const char *p = s->begin;
+
+     while (p < s->end) {
+	  struct log_record rec;
+	  if (csvlog_parse_line(&p, s->end, &rec) == -1)
+	       continue;
+	  if (rec.value >= a->value_lower && rec.value <= a->value_upper) {
+	       epoch_stats_add(&s->stats, &rec);
+	       if (a->window_ns > 0)
+		    add_to_window(a, s, &rec);
+	  } else {
+	       /* The run of the last sample ends at a filtered sample. */
+	       epoch_stats_end_run(&s->stats, rec.timestamp);
+	       if (s->nwindows > 0)
+		    epoch_stats_end_run(&s->windows[s->nwindows-1].stats,
+					rec.timestamp);
+	  }
+     }
+}
+
+/**
+ * Split the log file into chunks at line boundaries.
+ */
+void split_chunks(struct analysis *a, const struct csvlog_map *map,
+		  size_t nchunks)
+{
+     const char *data = map->data;
+     const char *end = map->data+map->size;
+     
+     a->chunks = calloc(nchunks, sizeof(struct chunk));
+     if (a->chunks == NULL) {
+	  perror("Could not allocate memory");
+	  exit(-1);
+     }
+     
+     a->nchunks = 0;
+     const char *begin = data;
+     for (size_t i = 1; i <= nchunks && begin < end; i++) {
+	  const char *chunk_end = end;
+	  if (i < nchunks) {
+	       chunk_end = data + map->size/nchunks*i;
+	       if (chunk_end < begin)
+		    chunk_end = begin;
+	       chunk_end = csvlog_next_line(chunk_end, end);
+	  }
+	  a->chunks[a->nchunks].begin = begin;
+	  a->chunks[a->nchunks].end = chunk_end;
+	  a->nchunks++;
+	  begin = chunk_end;
+     }
+}
+
+/**
+ * Merge the epoch boundaries of all chunks into segments.
+ */
+void merge_boundaries(struct analysis *a, const struct csvlog_map *map)
+{
+     size_t n = 0;
+     for (size_t i = 0; i < a->nchunks; i++)
+	  n += a->chunks[i].nboundaries;
+
+     a->segments = malloc((n == 0 ? 1 : n)*sizeof(struct segment));
+     if (a->segments == NULL) {
+	  perror("Could not allocate memory");
+	  exit(-1);
+     }
+
+     /* A chunk starting within an epoch reports a boundary at its first
+	line, which is only a real boundary if the epoch differs from the
+	last epoch of the previous chunk. */
+     a->nsegments = 0;
+     for (size_t i = 0; i < a->nchunks; i++) {
+	  const struct chunk *c = &a->chunks[i];
+	  for (size_t j = 0; j < c->nboundaries; j++) {
+	       const struct boundary *b = &c->boundaries[j];
+	       if (a->nsegments > 0 &&
+		   a->segments[a->nsegments-1].stats.epoch == b->epoch)
+		    continue;
+	       if (a->nsegments > 0)
+		    a->segments[a->nsegments-1].end = b->pos;
+	       struct segment *s = &a->segments[a->nsegments++];
+	       s->begin = b->pos;
+	       s->windows = NULL;
+	       s->nwindows = 0;
+	       s->capacity = 0;
+	       epoch_stats_init(&s->stats, b->epoch, a->leakage);
+	  }
+     }
+
+     if (a->nsegments > 0)
+	  a->segments[a->nsegments-1].end = map->data+map->size;
+}
+
+/**
+ * Print statistics as CSV.
+ *
+ * @param s the statistics
+ * @param window_start start of the time window, or NULL for statistics of
+ * a whole epoch
+ * @param leakage leakage model to be subtracted from energy and power,
+ * or NULL
+ */
+void print_stats(const struct epoch_stats *s, const double *window_start,
+		 const struct leakage_model *leakage)
+{
+     if (s->samples == 0)
+	  return;
+
+     double duration = epoch_stats_duration(s);
+     double energy = epoch_stats_energy(s);
+     double power = epoch_stats_power(s);
+     double power_fit = linfit_power(&s->fit);
+     if (leakage != NULL) {
+	  energy = leakage_compensate(energy, epoch_stats_leakage_energy(s));
+	  power = (duration == 0.0 ? 0.0 : energy/duration);
+	  power_fit = leakage_compensate(power_fit,
+					 leakage_power(leakage, s->fit.mean_y));
+     }
+     
+     printf("%llu,", (unsigned long long) s->epoch);
+     if (window_start != NULL)
+	  printf("%.9g,", *window_start);
+     printf("%llu,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+	    (unsigned long long) s->samples, duration, energy, power,
+	    power_fit, linfit_power_ci95(&s->fit));
+}
+
+/**
+ * Fit a leakage model from the time windows of all epochs of a no-load
+ * measurement and save it.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int calibrate_leakage(const struct analysis *a, const char *modelfile)
+{
+     size_t n = 0;
+     for (size_t i = 0; i < a->nsegments; i++)
+	  n += a->segments[i].nwindows;
+
+     struct epoch_stats *windows = malloc((n == 0 ? 1 : n)*
+					  sizeof(struct epoch_stats));
+     if (windows == NULL) {
+	  perror("Could not allocate memory");
+	  return -1;
+     }
+
+     n = 0;
+     for (size_t i = 0; i < a->nsegments; i++) {
+	  for (size_t j = 0; j < a->segments[i].nwindows; j++)
+	       windows[n++] = a->segments[i].windows[j].stats;
+     }
+
+     struct leakage_model m;
+     int status = leakage_fit(&m, windows, n);
+     free(windows);
+     if (status == -1) {
+	  fprintf(stderr, "Not enough time windows to fit leakage model\n");
+	  return -1;
+     }
+
+     if (leakage_save(&m, modelfile) == -1) {
+	  perror("Could not write leakage model");
+	  return -1;
+     }
+
+     /* Output format: comma-separated values
+	p0 [W], g [W/V^2], minimum V^2 [V^2], maximum V^2 [V^2] */
+     printf("%.9g,%.9g,%.9g,%.9g\n", m.p0, m.g, m.v2_min, m.v2_max);
+
+     return 0;
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+     struct analysis a;
+     a.value_lower = 0;
+     a.value_upper = UINT16_MAX;
+     a.window_ns = 0;
+     a.leakage = NULL;
+     char *calibrate_arg = NULL;
+     char *leakage_arg = NULL;
+     int c;
+     while ((c = getopt(argc, argv, "j:l:u:w:L:c:")) != -1) {
+	  switch (c) {
+	  case 'j' :
+	       nworkers = atol(optarg);
+	       break;
+	  case 'l' :
+	       a.value_lower = atoi(optarg);
+	       break;
+	  case 'u' :
+	       a.value_upper = atoi(optarg);
+	       break;
+	  case 'w' :
+	       a.window_ns = (uint64_t) (strtod(optarg, NULL)*1000000000.0 +
+					 0.5);
+	       break;
+	  case 'L' :
+	       calibrate_arg = optarg;
+	       break;
+	  case 'c' :
+	       leakage_arg = optarg;
+	       break;
+	  case '?' :
+	       fprintf(stderr, "Unknown option\n");
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc-1) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+
+     if (nworkers < 1)
+	  nworkers = 1;
+
+     /* Leakage is calibrated from time windows. */
+     if (calibrate_arg != NULL && a.window_ns == 0)
+	  a.window_ns = LEAKAGE_WINDOW_NS;
+
+     struct leakage_model leakage;
+     if (leakage_arg != NULL) {
+	  if (leakage_load(&leakage, leakage_arg) == -1) {
+	       fprintf(stderr, "Could not read leakage model\n");
+	       exit(-1);
+	  }
+	  a.leakage = &leakage;
+     }
+
+     struct csvlog_map map;
+     if (csvlog_map_open(argv[optind], &map) == -1) {
+	  perror("Could not open log file");
+	  exit(-1);
+     }
+     if (csvlog_is_tick_log(&map)) {
+	  fprintf(stderr, "Tick logs must be converted first (lem-convert -t)\n");
+	  csvlog_map_close(&map);
+	  exit(-1);
+     }
+
+     /* Find epoch boundaries in parallel chunks. */
+
+     split_chunks(&a, &map, nworkers*CHUNKS_PER_WORKER);
+     if (workpool_run(nworkers, a.nchunks, find_boundaries, &a) == -1)
+	  perror("Could not create all worker threads");
+
+     merge_boundaries(&a, &map);
+
+     /* Calculate the statistics of each epoch. Every segment is analyzed
+	by a single worker in file order, so the results do not depend on
+	the number of workers. */
+     
+     if (workpool_run(nworkers, a.nsegments, analyze_segment, &a) == -1)
+	  perror("Could not create all worker threads");
+
+     int status = 0;
+     if (calibrate_arg != NULL) {
+	  status = calibrate_leakage(&a, calibrate_arg);
+	  goto out;
+     }
+     
+     /* Output format: comma-separated values
+	epoch, samples, duration [s], energy [J], power [W], 
+	fitted power [W], 95 % confidence interval of fitted power [+/- W]
+	With time windows, each line starts with the epoch and the start of
+	the window relative to the start of the epoch [s]. */
+     for (size_t i = 0; i < a.nsegments; i++) {
+	  const struct segment *seg = &a.segments[i];
+	  if (a.window_ns == 0) {
+	       print_stats(&seg->stats, NULL, a.leakage);
+	       continue;
+	  }
+	  for (size_t j = 0; j < seg->nwindows; j++) {
+	       double start = (seg->windows[j].start-seg->stats.t_first)/
+		    1000000000.0;
+	       print_stats(&seg->windows[j].stats, &start, a.leakage);
+	  }
+     }
+
+out:
+     for (size_t i = 0; i < a.nsegments; i++)
+	  free(a.segments[i].windows);
+     for (size_t i = 0; i < a.nchunks; i++)
+	  free(a.chunks[i].boundaries);
+     free(a.chunks);
+     free(a.segments);
+     csvlog_map_close(&map);
+     
+     return status;
+}
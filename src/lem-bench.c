@@ -0,0 +1,659 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "ring.h"
+#include "timing.h"
+#include "clocksrc.h"
+#include "csvlog.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define DEFAULT_BATCH 64
+#define DEFAULT_DURATION 2.0
+#define DEFAULT_RATES "1000,10000"
+
+/* Batch size of the logger thread of the simulated pipeline. */
+#define PIPELINE_BATCH 64
+
+/* Tick at which the drift of the sampling schedule is measured. */
+#define DRIFT_TICK 1000000000ull
+
+/* Sampling frequencies [Hz] of the drift measurement and check, including
+   frequencies with a fractional part in units of 1/SCHEDULE_FREQUENCY_SCALE
+   Hz. */
+const double drift_frequencies[] = {7.0, 3.0, 7.5, 3000.0, 2999.999, 44100.0,
+				    9999.0, 1000000.0};
+
+struct ring the_ring;
+
+/* Prevents the compiler from optimizing away benchmarked code. */
+volatile uint64_t sink;
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-n ITERATIONS] [-b BATCH] [-r RATE[,RATE...]] "
+	     "[-d SECONDS] [-p TASK_PRIORITY]\n", appl);
+     fprintf(stderr, "%s -c\n", appl);
+}
+
+/**
+ * Current time.
+ *
+ * @return monotonic time in nanoseconds
+ */
+uint64_t now()
+{
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+     return to_nanosec(t);
+}
+
+/**
+ * Print a result as CSV line: benchmark, parameter, metric, value.
+ */
+void result(const char *bench, const char *param, const char *metric,
+	    double value)
+{
+     printf("%s,%s,%s,%.9g\n", bench, param, metric, value);
+     fflush(stdout);
+}
+
+/**
+ * Pin the calling thread to a CPU.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int pin(int cpu)
+{
+     cpu_set_t set;
+     CPU_ZERO(&set);
+     CPU_SET(cpu, &set);
+     return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ?
+	     0 : -1);
+}
+
+/**
+ * Set real-time priority of the calling thread.
+ */
+void set_priority(int priority)
+{
+     struct sched_param schedparam;
+     schedparam.sched_priority = priority;
+     if (priority > 0 &&
+	 sched_setscheduler(0, SCHED_FIFO, &schedparam) == -1)
+	  perror("sched_setscheduler failed");
+}
+
+/**
+ * Fill entries with synthetic samples.
+ */
+void make_entries(struct ring_entry *e, unsigned int n, uint64_t first)
+{
+     for (unsigned int i = 0; i < n; i++) {
+	  e[i].timestamp = first+i;
+	  e[i].epoch = 1;
+	  e[i].value = 2457-(first+i)%820;
+	  e[i].type = RING_ENTRY_SAMPLE;
+	  e[i].tick = first+i;
+     }
+}
+
+/**
+ * Put and get entries alternately in a single thread, i.e., without
+ * contention.
+ */
+void bench_ring_single_thread(unsigned long iterations, unsigned int batch)
+{
+     struct ring_entry *e = malloc(batch*sizeof(struct ring_entry));
+     
+     make_entries(e, 1, 0);
+     uint64_t t0 = now();
+     for (unsigned long i = 0; i < iterations; i++) {
+	  ring_put(&the_ring, &e[0]);
+	  ring_get(&the_ring, &e[0]);
+     }
+     uint64_t t1 = now();
+     result("ring_single", "same_thread", "ns_per_entry",
+	    (double) (t1-t0)/iterations);
+
+     make_entries(e, batch, 0);
+     unsigned long nbatches = iterations/batch;
+     t0 = now();
+     for (unsigned long i = 0; i < nbatches; i++) {
+	  ring_put_batch(&the_ring, e, batch);
+	  ring_get_batch(&the_ring, e, batch);
+     }
+     t1 = now();
+     result("ring_batch", "same_thread", "ns_per_entry",
+	    (double) (t1-t0)/(nbatches*batch));
+
+     free(e);
+}
+
+/**
+ * Arguments of producer and consumer threads.
+ */
+struct pc_args {
+     unsigned long iterations;
+     unsigned int batch;
+     int cpu;
+     bool pinned;
+};
+
+void *producer(void *args)
+{
+     struct pc_args *a = (struct pc_args *) args;
+     struct ring_entry *e = malloc(a->batch*sizeof(struct ring_entry));
+     
+     a->pinned = (pin(a->cpu) == 0);
+     unsigned long n = 0;
+     while (n < a->iterations) {
+	  unsigned int m = a->batch;
+	  if (m > a->iterations-n)
+	       m = a->iterations-n;
+	  make_entries(e, m, n);
+	  if (a->batch == 1)
+	       ring_put(&the_ring, e);
+	  else
+	       ring_put_batch(&the_ring, e, m);
+	  n += m;
+     }
+
+     free(e);
+     return NULL;
+}
+
+void *consumer(void *args)
+{
+     struct pc_args *a = (struct pc_args *) args;
+     struct ring_entry *e = malloc(a->batch*sizeof(struct ring_entry));
+     
+     a->pinned = (pin(a->cpu) == 0);
+     unsigned long n = 0;
+     uint64_t sum = 0;
+     while (n < a->iterations) {
+	  unsigned int m = 1;
+	  if (a->batch == 1)
+	       ring_get(&the_ring, e);
+	  else
+	       m = ring_get_batch(&the_ring, e, a->batch);
+	  for (unsigned int i = 0; i < m; i++)
+	       sum += e[i].value;
+	  n += m;
+     }
+     sink = sum;
+
+     free(e);
+     return NULL;
+}
+
+/**
+ * Transfer entries from a producer thread to a consumer thread.
+ */
+void bench_ring_threads(unsigned long iterations, unsigned int batch,
+			int cpu_producer, int cpu_consumer)
+{
+     struct pc_args p = {iterations, batch, cpu_producer, false};
+     struct pc_args c = {iterations, batch, cpu_consumer, false};
+     pthread_t tp, tc;
+
+     uint64_t t0 = now();
+     if (pthread_create(&tc, NULL, consumer, &c) ||
+	 pthread_create(&tp, NULL, producer, &p)) {
+	  perror("Could not create thread");
+	  exit(-1);
+     }
+     pthread_join(tp, NULL);
+     pthread_join(tc, NULL);
+     uint64_t t1 = now();
+
+     if (!p.pinned || !c.pinned)
+	  fprintf(stderr, "Could not pin threads to CPUs\n");
+     result(batch == 1 ? "ring_single" : "ring_batch",
+	    cpu_producer == cpu_consumer ? "same_core" : "different_cores",
+	    "ns_per_entry", (double) (t1-t0)/iterations);
+}
+
+/**
+ * Format samples as written by the logger thread.
+ */
+void bench_log_sample(unsigned long iterations)
+{
+     FILE *f = fopen("/dev/null", "w");
+     if (f == NULL) {
+	  perror("Could not open /dev/null");
+	  exit(-1);
+     }
+
+     /* Realistic values: 1 kHz sampling, ADC counts of a discharge. */
+     uint64_t t = 1000000000000ull;
+     uint64_t t0 = now();
+     for (unsigned long i = 0; i < iterations; i++)
+	  csvlog_write_sample(f, t+i*1000000, 1, 2457-i%820);
+     uint64_t t1 = now();
+     result("log_sample", "devnull", "ns_per_sample",
+	    (double) (t1-t0)/iterations);
+     
+     t0 = now();
+     for (unsigned long i = 0; i < iterations; i++)
+	  csvlog_write_run(f, t+i*1000000, 1, 2457-i%820, 1+i%8);
+     t1 = now();
+     result("log_run", "devnull", "ns_per_record",
+	    (double) (t1-t0)/iterations);
+
+     fclose(f);
+}
+
+/**
+ * Time helpers of the sampling loop.
+ */
+void bench_timing(unsigned long iterations)
+{
+     struct timespec interval = frequency_to_interval(1000.0);
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+
+     uint64_t t0 = now();
+     for (unsigned long i = 0; i < iterations; i++)
+	  t = next_sampling_time(t, interval);
+     uint64_t t1 = now();
+     sink = t.tv_nsec;
+     result("next_sampling_time", "1000Hz", "ns_per_call",
+	    (double) (t1-t0)/iterations);
+
+     uint64_t sum = 0;
+     t0 = now();
+     for (unsigned long i = 0; i < iterations; i++) {
+	  t.tv_nsec = i%1000000000;
+	  sum += to_nanosec(t);
+     }
+     t1 = now();
+     sink = sum;
+     result("to_nanosec", "", "ns_per_call", (double) (t1-t0)/iterations);
+
+     t0 = now();
+     for (unsigned long i = 0; i < iterations; i++) {
+	  clock_gettime(CLOCK_MONOTONIC, &t);
+	  sum += t.tv_nsec;
+     }
+     t1 = now();
+     sink = sum;
+     result("clock_gettime", "monotonic", "ns_per_call",
+	    (double) (t1-t0)/iterations);
+
+     // Timestamps of the sampling thread with and without hardware counter.
+     struct clocksrc cs;
+     clocksrc_init(&cs, false);
+     t0 = now();
+     for (unsigned long i = 0; i < iterations; i++)
+	  sum += clocksrc_now(&cs);
+     t1 = now();
+     sink = sum;
+     result("clocksrc_now", "clock_gettime", "ns_per_call",
+	    (double) (t1-t0)/iterations);
+     if (clocksrc_init(&cs, true) == 0) {
+	  result("clocksrc_now", "counter", "frequency_hz",
+		 clocksrc_frequency(&cs));
+	  t0 = now();
+	  for (unsigned long i = 0; i < iterations; i++)
+	       sum += clocksrc_now(&cs);
+	  t1 = now();
+	  sink = sum;
+	  result("clocksrc_now", "counter", "ns_per_call",
+		 (double) (t1-t0)/iterations);
+	  // Deviation from CLOCK_MONOTONIC (including the time between
+	  // both calls).
+	  int64_t max_dev = 0;
+	  for (unsigned long i = 0; i < iterations; i++) {
+	       int64_t dev = (int64_t) (clocksrc_now(&cs)-now());
+	       if (dev < 0)
+		    dev = -dev;
+	       if (dev > max_dev)
+		    max_dev = dev;
+	  }
+	  result("clocksrc_now", "counter", "max_deviation_ns",
+		 (double) max_dev);
+     } else {
+	  result("clocksrc_now", "counter", "unsupported", 1.0);
+     }
+
+     struct schedule sched;
+     schedule_init(&sched, 3000.0);
+     t0 = now();
+     for (unsigned long i = 0; i < iterations; i++)
+	  sum += schedule_advance(&sched, 1);
+     t1 = now();
+     sink = sum;
+     result("schedule_advance", "3000Hz", "ns_per_call",
+	    (double) (t1-t0)/iterations);
+}
+
+/**
+ * Exact deadline floor(k*1e9/f) of tick k of a schedule started at time 0.
+ *
+ * @param sched the schedule with frequency f
+ * @param k the tick
+ * @return deadline [ns]
+ */
+uint64_t exact_deadline(const struct schedule *sched, uint64_t k)
+{
+     return (uint64_t) ((unsigned __int128) k*1000000000ull*
+			SCHEDULE_FREQUENCY_SCALE/sched->num);
+}
+
+/**
+ * Deviation of the deadline of tick 10^9 from the exact deadline
+ * floor(k*1e9/f) when adding the rounded sampling interval, and with the
+ * drift-free schedule (closed form and incremental).
+ */
+void bench_drift(void)
+{
+     const uint64_t k = DRIFT_TICK;
+     char param[32];
+     
+     for (unsigned int i = 0;
+	  i < sizeof(drift_frequencies)/sizeof(drift_frequencies[0]); i++) {
+	  double f = drift_frequencies[i];
+	  struct schedule sched;
+	  schedule_init(&sched, f);
+	  uint64_t exact = exact_deadline(&sched, k);
+	  snprintf(param, sizeof(param), "%.3fHz", f);
+	  
+	  struct timespec interval = frequency_to_interval(f);
+	  result("drift_rounded_interval", param, "ns_at_tick_1e9",
+		 (double) (int64_t) (k*to_nanosec(interval)-exact));
+
+	  result("drift_schedule", param, "ns_at_tick_1e9",
+		 (double) (int64_t) (schedule_deadline(&sched, k)-exact));
+	  // Advance in steps, as the sampling thread does.
+	  for (unsigned int j = 0; j < 1000; j++)
+	       schedule_advance(&sched, k/1000);
+	  result("drift_schedule_incremental", param, "ns_at_tick_1e9",
+		 (double) (int64_t) (sched.t-exact));
+     }
+}
+
+/**
+ * Check that the deadline of tick 10^9 of the sampling schedule is exact,
+ * both in closed form and when advancing the schedule in steps, and that
+ * the frequency is represented exactly.
+ *
+ * @return number of failed checks
+ */
+unsigned int check_drift(void)
+{
+     const uint64_t k = DRIFT_TICK;
+     unsigned int failed = 0;
+     
+     for (unsigned int i = 0;
+	  i < sizeof(drift_frequencies)/sizeof(drift_frequencies[0]); i++) {
+	  double f = drift_frequencies[i];
+	  struct schedule sched;
+	  if (schedule_init(&sched, f) == -1 ||
+	      sched.num != (uint64_t) (f*SCHEDULE_FREQUENCY_SCALE+0.5)) {
+	       fprintf(stderr, "FAIL schedule %.3f Hz: invalid frequency\n", f);
+	       failed++;
+	       continue;
+	  }
+	  uint64_t exact = exact_deadline(&sched, k);
+
+	  uint64_t t = schedule_deadline(&sched, k);
+	  if (t != exact) {
+	       fprintf(stderr, "FAIL schedule_deadline %.3f Hz: %llu ns, "
+		       "expected %llu ns\n", f, (unsigned long long) t,
+		       (unsigned long long) exact);
+	       failed++;
+	  }
+
+	  for (unsigned int j = 0; j < 1000; j++)
+	       schedule_advance(&sched, k/1000);
+	  if (sched.t != exact) {
+	       fprintf(stderr, "FAIL schedule_advance %.3f Hz: %llu ns, "
+		       "expected %llu ns\n", f, (unsigned long long) sched.t,
+		       (unsigned long long) exact);
+	       failed++;
+	  }
+     }
+
+     return failed;
+}
+
+/**
+ * State of the simulated pipeline.
+ */
+struct pipeline {
+     double rate;
+     unsigned long nsamples;
+     int priority;
+     
+     uint64_t wakeup_latency_max;
+     uint64_t wakeup_latency_sum;
+     unsigned int ring_high_water;
+     uint64_t log_latency_max;
+};
+
+/**
+ * Simulated sampling thread: takes synthetic samples at the given rate like
+ * the sampling loop of low-energy-meter.
+ */
+void *pipeline_sampler(void *args)
+{
+     struct pipeline *p = (struct pipeline *) args;
+     set_priority(p->priority);
+     
+     struct timespec interval = frequency_to_interval(p->rate);
+     struct timespec tsample;
+     clock_gettime(CLOCK_MONOTONIC, &tsample);
+     for (unsigned long i = 0; i < p->nsamples; i++) {
+	  struct timespec tnow;
+	  clock_gettime(CLOCK_MONOTONIC, &tnow);
+	  uint64_t tnow_ns = to_nanosec(tnow);
+	  uint64_t tsample_ns = to_nanosec(tsample);
+	  if (tnow_ns > tsample_ns) {
+	       uint64_t latency = tnow_ns-tsample_ns;
+	       p->wakeup_latency_sum += latency;
+	       if (latency > p->wakeup_latency_max)
+		    p->wakeup_latency_max = latency;
+	  }
+
+	  struct ring_entry entry;
+	  entry.timestamp = tnow_ns;
+	  entry.epoch = 1;
+	  entry.value = 2457-i%820;
+	  entry.type = RING_ENTRY_SAMPLE;
+	  entry.tick = i;
+	  unsigned int fill = ring_put(&the_ring, &entry);
+	  if (fill > p->ring_high_water)
+	       p->ring_high_water = fill;
+
+	  tsample = next_sampling_time(tsample, interval);
+	  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tsample, NULL);
+     }
+
+     return NULL;
+}
+
+/**
+ * Simulated logger thread: writes samples to /dev/null.
+ */
+void *pipeline_logger(void *args)
+{
+     struct pipeline *p = (struct pipeline *) args;
+     set_priority(p->priority-1);
+     
+     FILE *f = fopen("/dev/null", "w");
+     if (f == NULL) {
+	  perror("Could not open /dev/null");
+	  exit(-1);
+     }
+
+     unsigned long n = 0;
+     while (n < p->nsamples) {
+	  struct ring_entry entries[PIPELINE_BATCH];
+	  unsigned int m = ring_get_batch(&the_ring, entries, PIPELINE_BATCH);
+	  for (unsigned int i = 0; i < m; i++) {
+	       csvlog_write_sample(f, entries[i].timestamp, entries[i].epoch,
+				   entries[i].value);
+	       uint64_t latency = now()-entries[i].timestamp;
+	       if (latency > p->log_latency_max)
+		    p->log_latency_max = latency;
+	  }
+	  n += m;
+     }
+
+     fclose(f);
+     return NULL;
+}
+
+/**
+ * Run the simulated pipeline at a given sampling rate.
+ */
+void bench_pipeline(double rate, double duration, int priority)
+{
+     struct pipeline p;
+     memset(&p, 0, sizeof(p));
+     p.rate = rate;
+     p.nsamples = (unsigned long) (rate*duration+0.5);
+     p.priority = priority;
+     if (p.nsamples == 0)
+	  return;
+
+     pthread_t ts, tl;
+     uint64_t t0 = now();
+     if (pthread_create(&tl, NULL, pipeline_logger, &p) ||
+	 pthread_create(&ts, NULL, pipeline_sampler, &p)) {
+	  perror("Could not create thread");
+	  exit(-1);
+     }
+     pthread_join(ts, NULL);
+     pthread_join(tl, NULL);
+     uint64_t t1 = now();
+
+     char param[32];
+     snprintf(param, sizeof(param), "%gHz", rate);
+     result("pipeline", param, "achieved_rate",
+	    p.nsamples/((t1-t0)/1000000000.0));
+     result("pipeline", param, "wakeup_latency_mean_ns",
+	    (double) p.wakeup_latency_sum/p.nsamples);
+     result("pipeline", param, "wakeup_latency_max_ns", p.wakeup_latency_max);
+     result("pipeline", param, "ring_high_water", p.ring_high_water);
+     result("pipeline", param, "log_latency_max_ns", p.log_latency_max);
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     unsigned long iterations = DEFAULT_ITERATIONS;
+     unsigned int batch = DEFAULT_BATCH;
+     double duration = DEFAULT_DURATION;
+     const char *rates = DEFAULT_RATES;
+     int priority = 0;
+     bool is_check = false;
+     int c;
+     while ((c = getopt(argc, argv, "n:b:r:d:p:c")) != -1) {
+	  switch (c) {
+	  case 'c' :
+	       is_check = true;
+	       break;
+	  case 'n' :
+	       iterations = strtoul(optarg, NULL, 10);
+	       break;
+	  case 'b' :
+	       batch = strtoul(optarg, NULL, 10);
+	       break;
+	  case 'r' :
+	       rates = optarg;
+	       break;
+	  case 'd' :
+	       duration = strtod(optarg, NULL);
+	       break;
+	  case 'p' :
+	       priority = atoi(optarg);
+	       break;
+	  default :
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc || iterations == 0 || batch == 0 ||
+	 batch > RING_SIZE) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+
+     /* Correctness checks only (make check). */
+     if (is_check) {
+	  unsigned int failed = check_drift();
+	  fprintf(stderr, "%u checks failed\n", failed);
+	  return (failed == 0 ? 0 : 1);
+     }
+
+     if (ring_init(&the_ring, RING_SIZE) == -1) {
+	  perror("Could not initialize ring");
+	  exit(-1);
+     }
+
+     long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+     printf("benchmark,parameter,metric,value\n");
+     result("info", "", "cpus", ncpus);
+     result("info", "", "iterations", iterations);
+     result("info", "", "batch", batch);
+     
+     bench_ring_single_thread(iterations, batch);
+     bench_ring_threads(iterations, 1, 0, 0);
+     bench_ring_threads(iterations, batch, 0, 0);
+     if (ncpus > 1) {
+	  bench_ring_threads(iterations, 1, 0, 1);
+	  bench_ring_threads(iterations, batch, 0, 1);
+     }
+     bench_log_sample(iterations);
+     bench_timing(iterations);
+     bench_drift();
+
+     const char *p = rates;
+     while (*p != '\0') {
+	  char *end;
+	  double rate = strtod(p, &end);
+	  if (end == p || rate <= 0.0) {
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+	  bench_pipeline(rate, duration, priority);
+	  p = (*end == ',' ? end+1 : end);
+     }
+
+     ring_destroy(&the_ring);
+
+     return 0;
+}
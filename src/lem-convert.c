@@ -0,0 +1,273 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "csvlog.h"
+#include "colstore.h"
+#include "filter.h"
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-g GROUP_ROWS] LOGFILE COLFILE\n", appl);
+     fprintf(stderr, "%s -t TICKLOG LOGFILE\n", appl);
+     fprintf(stderr, "%s -d [-e EPOCH] [-l LOWER_THRESHOLD] "
+	     "[-u UPPER_THRESHOLD] COLFILE\n", appl);
+}
+
+/**
+ * Parse the next line of a CSV log file or a tick log.
+ *
+ * @param p pointer to the beginning of the line; on return, points to the
+ * beginning of the next line
+ * @param end end of the buffer
+ * @param s state of reading a tick log, or NULL for CSV log files
+ * @param rec the parsed record
+ * @return 0 on success, or -1 if the line does not contain a record.
+ */
+int next_record(const char **p, const char *end, struct csvlog_tick_state *s,
+		struct log_record *rec)
+{
+     if (s == NULL)
+	  return csvlog_parse_line(p, end, rec);
+     
+     return (csvlog_parse_tick_line(p, end, s, rec) == 0 ? 0 : -1);
+}
+
+/**
+ * Convert a tick log to a CSV log file with a timestamp per sample.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int expand(const char *ticklog, const char *logfile)
+{
+     struct csvlog_map map;
+     if (csvlog_map_open(ticklog, &map) == -1) {
+	  perror("Could not open tick log");
+	  return -1;
+     }
+     if (!csvlog_is_tick_log(&map)) {
+	  fprintf(stderr, "Not a tick log\n");
+	  csvlog_map_close(&map);
+	  return -1;
+     }
+
+     FILE *f = fopen(logfile, "w");
+     if (f == NULL) {
+	  perror("Could not create log file");
+	  csvlog_map_close(&map);
+	  return -1;
+     }
+
+     int status = 0;
+     struct csvlog_tick_state s;
+     csvlog_tick_init(&s);
+     const char *p = map.data;
+     const char *end = map.data+map.size;
+     while (p < end) {
+	  struct log_record rec;
+	  if (next_record(&p, end, &s, &rec) == -1)
+	       continue;
+	  if (csvlog_write_sample(f, rec.timestamp, rec.epoch,
+				  rec.value) < 0) {
+	       status = -1;
+	       break;
+	  }
+     }
+
+     if (fclose(f) != 0)
+	  status = -1;
+     if (status == -1)
+	  perror("Could not write log file");
+     
+     csvlog_map_close(&map);
+
+     return status;
+}
+
+/**
+ * Convert a CSV log file or a tick log to a columnar file.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int convert(const char *logfile, const char *colfile, uint32_t group_rows)
+{
+     struct csvlog_map map;
+     if (csvlog_map_open(logfile, &map) == -1) {
+	  perror("Could not open log file");
+	  return -1;
+     }
+
+     struct colstore_writer w;
+     if (colstore_writer_open(&w, colfile, group_rows) == -1) {
+	  perror("Could not create columnar file");
+	  csvlog_map_close(&map);
+	  return -1;
+     }
+
+     int status = 0;
+     struct csvlog_tick_state s;
+     csvlog_tick_init(&s);
+     struct csvlog_tick_state *ps = (csvlog_is_tick_log(&map) ? &s : NULL);
+     const char *p = map.data;
+     const char *end = map.data+map.size;
+     while (p < end) {
+	  struct log_record rec;
+	  if (next_record(&p, end, ps, &rec) == -1)
+	       continue;
+	  if (colstore_writer_add(&w, &rec) == -1) {
+	       status = -1;
+	       break;
+	  }
+     }
+
+     if (colstore_writer_close(&w) == -1)
+	  status = -1;
+     if (status == -1)
+	  perror("Could not write columnar file");
+     
+     csvlog_map_close(&map);
+
+     return status;
+}
+
+/**
+ * Print the records of a columnar file passing a filter as CSV. Row groups
+ * are skipped according to their statistics.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int dump(const char *colfile, const struct record_filter *f)
+{
+     struct colstore_reader r;
+     if (colstore_reader_open(&r, colfile) == -1) {
+	  fprintf(stderr, "Could not open columnar file\n");
+	  return -1;
+     }
+
+     struct log_record *rows = malloc(r.group_rows*sizeof(struct log_record));
+     if (rows == NULL) {
+	  perror("Could not allocate memory");
+	  colstore_reader_close(&r);
+	  return -1;
+     }
+
+     int status;
+     unsigned long groups = 0;
+     unsigned long skipped = 0;
+     struct colstore_group_header h;
+     while ((status = colstore_next_group(&r, &h)) == 1) {
+	  groups++;
+	  if (!colstore_group_overlaps(&h, f)) {
+	       skipped++;
+	       if (colstore_skip_group(&r, &h) == -1) {
+		    status = -1;
+		    break;
+	       }
+	       continue;
+	  }
+	  if (colstore_read_group(&r, &h, rows) == -1) {
+	       status = -1;
+	       break;
+	  }
+	  for (uint32_t i = 0; i < h.rows; i++) {
+	       if (!record_filter_match(f, &rows[i]))
+		    continue;
+	       printf("%llu,%llu,%d", (unsigned long long) rows[i].timestamp,
+		      (unsigned long long) rows[i].epoch, rows[i].value);
+	       if (rows[i].count != 1)
+		    printf(",%u", rows[i].count);
+	       printf("\n");
+	  }
+     }
+
+     if (status == -1)
+	  fprintf(stderr, "Corrupted columnar file\n");
+     else
+	  fprintf(stderr, "Skipped %lu of %lu row groups\n", skipped, groups);
+
+     free(rows);
+     colstore_reader_close(&r);
+
+     return (status == -1 ? -1 : 0);
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     bool decode = false;
+     bool is_expand = false;
+     uint32_t group_rows = COLSTORE_GROUP_ROWS;
+     struct record_filter f;
+     record_filter_init(&f);
+     int c;
+     while ((c = getopt(argc, argv, "dg:e:l:u:t")) != -1) {
+	  switch (c) {
+	  case 'd' :
+	       decode = true;
+	       break;
+	  case 't' :
+	       is_expand = true;
+	       break;
+	  case 'g' :
+	       group_rows = strtoul(optarg, NULL, 10);
+	       break;
+	  case 'e' :
+	       f.epoch_min = f.epoch_max = strtoull(optarg, NULL, 10);
+	       break;
+	  case 'l' :
+	       f.value_min = atoi(optarg);
+	       break;
+	  case 'u' :
+	       f.value_max = atoi(optarg);
+	       break;
+	  case '?' :
+	       fprintf(stderr, "Unknown option\n");
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if ((decode && optind != argc-1) || (!decode && optind != argc-2) ||
+	 group_rows == 0 || group_rows > COLSTORE_MAX_GROUP_ROWS ||
+	 (decode && is_expand)) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+
+     int status;
+     if (decode)
+	  status = dump(argv[optind], &f);
+     else if (is_expand)
+	  status = expand(argv[optind], argv[optind+1]);
+     else
+	  status = convert(argv[optind], argv[optind+1], group_rows);
+
+     return status;
+}
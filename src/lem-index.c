@@ -0,0 +1,212 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "csvlog.h"
+#include "logindex.h"
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-b BUCKET_SECONDS] [-o INDEXFILE] LOGFILE\n", appl);
+     fprintf(stderr, "%s -e EPOCH [-s START_SECONDS] [-t END_SECONDS] "
+	     "[-o INDEXFILE] LOGFILE\n", appl);
+}
+
+/**
+ * Create the index of a log file.
+ *
+ * @param map the mapped log file
+ * @param indexfile path of the index file
+ * @param bucket_ns width of time buckets in nanoseconds
+ * @return 0 on success, or -1 in case of an error.
+ */
+int create_index(const struct csvlog_map *map, const char *indexfile,
+		 uint64_t bucket_ns)
+{
+     struct logindex_writer w;
+     if (logindex_writer_open(&w, indexfile, bucket_ns) == -1) {
+	  perror("Could not create index file");
+	  return -1;
+     }
+
+     const char *p = map->data;
+     const char *end = map->data+map->size;
+     while (p < end) {
+	  const char *line = p;
+	  struct log_record rec;
+	  if (csvlog_parse_line(&p, end, &rec) == -1)
+	       continue;
+	  if (logindex_writer_add(&w, line-map->data, rec.timestamp,
+				  rec.epoch) == -1) {
+	       perror("Could not write index file");
+	       logindex_writer_close(&w);
+	       return -1;
+	  }
+     }
+
+     if (logindex_writer_close(&w) == -1) {
+	  perror("Could not write index file");
+	  return -1;
+     }
+
+     return 0;
+}
+
+/**
+ * Print all records of an epoch within a time interval relative to the
+ * start of the epoch.
+ *
+ * @param map the mapped log file
+ * @param indexfile path of the index file
+ * @param epoch the epoch
+ * @param t0 start of the interval in nanoseconds
+ * @param t1 end of the interval in nanoseconds
+ */
+void print_slice(const struct csvlog_map *map, const char *indexfile,
+		 uint64_t epoch, uint64_t t0, uint64_t t1)
+{
+     uint64_t begin = 0;
+     uint64_t end = map->size;
+     bool has_start = false;
+     uint64_t tstart = 0;
+     
+     struct logindex idx;
+     if (logindex_open(&idx, indexfile) == 0) {
+	  /* The first entry of an epoch points to its first record. */
+	  size_t i = logindex_find_epoch(&idx, epoch);
+	  if (i == idx.nentries || idx.entries[i].epoch != epoch) {
+	       logindex_close(&idx);
+	       return;
+	  }
+	  tstart = idx.entries[i].timestamp;
+	  has_start = true;
+	  logindex_lookup(&idx, epoch, epoch, tstart+t0,
+			  (t1 == UINT64_MAX ? UINT64_MAX : tstart+t1),
+			  map->size, &begin, &end);
+	  logindex_close(&idx);
+     } else {
+	  fprintf(stderr, "No valid index file, scanning whole log file\n");
+     }
+
+     const char *p = map->data+begin;
+     const char *pend = map->data+end;
+     while (p < pend) {
+	  const char *line = p;
+	  struct log_record rec;
+	  if (csvlog_parse_line(&p, pend, &rec) == -1 || rec.epoch != epoch)
+	       continue;
+	  if (!has_start) {
+	       tstart = rec.timestamp;
+	       has_start = true;
+	  }
+	  uint64_t t = rec.timestamp-tstart;
+	  if (t >= t0 && t <= t1)
+	       fwrite(line, 1, p-line, stdout);
+     }
+}
+
+/**
+ * Convert seconds given as string to nanoseconds.
+ */
+uint64_t seconds_to_nanosec(const char *s)
+{
+     return (uint64_t) (strtod(s, NULL)*1000000000.0 + 0.5);
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+     
+     char *indexfile_arg = NULL;
+     char *epoch_arg = NULL;
+     uint64_t bucket_ns = LOGINDEX_BUCKET_NS;
+     uint64_t t0 = 0;
+     uint64_t t1 = UINT64_MAX;
+     int c;
+     while ((c = getopt(argc, argv, "b:o:e:s:t:")) != -1) {
+	  switch (c) {
+	  case 'b' :
+	       bucket_ns = seconds_to_nanosec(optarg);
+	       break;
+	  case 'o' :
+	       indexfile_arg = optarg;
+	       break;
+	  case 'e' :
+	       epoch_arg = optarg;
+	       break;
+	  case 's' :
+	       t0 = seconds_to_nanosec(optarg);
+	       break;
+	  case 't' :
+	       t1 = seconds_to_nanosec(optarg);
+	       break;
+	  case '?' :
+	       fprintf(stderr, "Unknown option\n");
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc-1 || bucket_ns == 0) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+     const char *logfile = argv[optind];
+
+     /* By default, the index file is stored next to the log file. */
+     char *indexfile;
+     if (indexfile_arg != NULL) {
+	  indexfile = indexfile_arg;
+     } else {
+	  indexfile = malloc(strlen(logfile)+strlen(".idx")+1);
+	  strcpy(indexfile, logfile);
+	  strcat(indexfile, ".idx");
+     }
+     
+     struct csvlog_map map;
+     if (csvlog_map_open(logfile, &map) == -1) {
+	  perror("Could not open log file");
+	  exit(-1);
+     }
+     if (csvlog_is_tick_log(&map)) {
+	  fprintf(stderr, "Tick logs must be converted first (lem-convert -t)\n");
+	  csvlog_map_close(&map);
+	  exit(-1);
+     }
+
+     int status = 0;
+     if (epoch_arg != NULL)
+	  print_slice(&map, indexfile, strtoull(epoch_arg, NULL, 10), t0, t1);
+     else
+	  status = create_index(&map, indexfile, bucket_ns);
+
+     csvlog_map_close(&map);
+     
+     return status;
+}
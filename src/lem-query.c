@@ -0,0 +1,452 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include "csvlog.h"
+#include "colstore.h"
+#include "epochstats.h"
+#include "filter.h"
+#include "leakage.h"
+#include "logindex.h"
+
+/* Aggregates calculated per epoch. */
+enum aggregate {AGG_COUNT, AGG_MIN, AGG_MAX, AGG_DURATION, AGG_ENERGY,
+		AGG_POWER, AGG_POWER_FIT, AGG_POWER_FIT_CI, AGG_NUM};
+
+const char *aggregate_names[AGG_NUM] = {"count", "min", "max", "duration",
+					"energy", "power", "pfit", "pfitci"};
+
+struct query {
+     /* Filter with absolute timestamps. The time range is only known
+	after the start of the first selected epoch (or the log file) was
+	found. */
+     struct record_filter f;
+     bool has_time_range;
+     uint64_t t0;
+     uint64_t t1;
+     bool has_start;
+
+     /* Statistics of the current epoch. */
+     struct epoch_stats stats;
+     bool has_stats;
+
+     enum aggregate aggs[AGG_NUM];
+     int naggs;
+
+     /* Leakage model subtracted from energy and power, or NULL. */
+     const struct leakage_model *leakage;
+
+     bool verbose;
+     unsigned long blocks;
+     unsigned long blocks_skipped;
+};
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [--epoch EPOCH] [--min MIN_COUNT] [--max MAX_COUNT] "
+	     "[--t0 SECONDS] [--t1 SECONDS] [--agg AGGREGATES] "
+	     "[--index INDEXFILE] [--leakage LEAKAGE_MODEL] [--verbose] LOGFILE\n",
+	     appl);
+     fprintf(stderr, "AGGREGATES: comma-separated list of count, min, max, "
+	     "duration, energy, power, pfit, pfitci\n");
+}
+
+/**
+ * Set the start time, to which --t0 and --t1 are relative.
+ */
+void query_set_start(struct query *q, uint64_t start)
+{
+     q->has_start = true;
+     if (q->has_time_range) {
+	  q->f.t_min = start+q->t0;
+	  q->f.t_max = (q->t1 == UINT64_MAX ? UINT64_MAX : start+q->t1);
+     }
+}
+
+/**
+ * Print the aggregates of the current epoch.
+ */
+void query_print(struct query *q)
+{
+     const struct epoch_stats *s = &q->stats;
+     
+     if (!q->has_stats || s->samples == 0)
+	  return;
+
+     double duration = epoch_stats_duration(s);
+     double energy = epoch_stats_energy(s);
+     double power = epoch_stats_power(s);
+     double power_fit = linfit_power(&s->fit);
+     if (q->leakage != NULL) {
+	  energy = leakage_compensate(energy, epoch_stats_leakage_energy(s));
+	  power = (duration == 0.0 ? 0.0 : energy/duration);
+	  power_fit = leakage_compensate(power_fit,
+					 leakage_power(q->leakage,
+						       s->fit.mean_y));
+     }
+
+     printf("%llu", (unsigned long long) s->epoch);
+     for (int i = 0; i < q->naggs; i++) {
+	  switch (q->aggs[i]) {
+	  case AGG_COUNT :
+	       printf(",%llu", (unsigned long long) s->samples);
+	       break;
+	  case AGG_MIN :
+	       printf(",%u", s->value_min);
+	       break;
+	  case AGG_MAX :
+	       printf(",%u", s->value_max);
+	       break;
+	  case AGG_DURATION :
+	       printf(",%.9g", duration);
+	       break;
+	  case AGG_ENERGY :
+	       printf(",%.9g", energy);
+	       break;
+	  case AGG_POWER :
+	       printf(",%.9g", power);
+	       break;
+	  case AGG_POWER_FIT :
+	       printf(",%.9g", power_fit);
+	       break;
+	  case AGG_POWER_FIT_CI :
+	       printf(",%.9g", linfit_power_ci95(&s->fit));
+	       break;
+	  default :
+	       break;
+	  }
+     }
+     printf("\n");
+}
+
+/**
+ * Evaluate the query for a record.
+ */
+void query_add(struct query *q, const struct log_record *rec)
+{
+     /* Records are ordered by time, so the first record of a selected
+	epoch is the start of the epoch. */
+     if (!q->has_start && rec->epoch >= q->f.epoch_min &&
+	 rec->epoch <= q->f.epoch_max)
+	  query_set_start(q, rec->timestamp);
+
+     if (!record_filter_match(&q->f, rec)) {
+	  /* The run of the last sample ends at a filtered sample. */
+	  if (q->has_stats && rec->epoch == q->stats.epoch)
+	       epoch_stats_end_run(&q->stats, rec->timestamp);
+	  return;
+     }
+
+     if (!q->has_stats || rec->epoch != q->stats.epoch) {
+	  query_print(q);
+	  epoch_stats_init(&q->stats, rec->epoch, q->leakage);
+	  q->has_stats = true;
+     }
+
+     epoch_stats_add(&q->stats, rec);
+}
+
+/**
+ * Evaluate the query over a range of a CSV log file.
+ */
+void query_csv_range(struct query *q, const char *p, const char *end)
+{
+     while (p < end) {
+	  struct log_record rec;
+	  if (csvlog_parse_line(&p, end, &rec) == 0)
+	       query_add(q, &rec);
+     }
+}
+
+/**
+ * Evaluate the query over a CSV log file. If an index is available, only
+ * the range of the log file possibly containing selected records is read.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int query_csv(struct query *q, const char *logfile, const char *indexfile)
+{
+     struct csvlog_map map;
+     if (csvlog_map_open(logfile, &map) == -1) {
+	  perror("Could not open log file");
+	  return -1;
+     }
+     if (csvlog_is_tick_log(&map)) {
+	  fprintf(stderr, "Tick logs must be converted first (lem-convert -t)\n");
+	  csvlog_map_close(&map);
+	  return -1;
+     }
+
+     uint64_t begin = 0;
+     uint64_t end = map.size;
+     struct logindex idx;
+     if (logindex_open(&idx, indexfile) == 0) {
+	  if (idx.nentries > 0) {
+	       /* Index entries point to the first records of epochs. */
+	       size_t i = 0;
+	       if (q->f.epoch_min > 0)
+		    i = logindex_find_epoch(&idx, q->f.epoch_min);
+	       if (i < idx.nentries && idx.entries[i].epoch <= q->f.epoch_max)
+		    query_set_start(q, idx.entries[i].timestamp);
+	       logindex_lookup(&idx, q->f.epoch_min, q->f.epoch_max,
+			       q->f.t_min, q->f.t_max, map.size, &begin, &end);
+	  }
+	  if (q->verbose)
+	       fprintf(stderr, "Reading %llu of %llu bytes using index\n",
+		       (unsigned long long) (end-begin),
+		       (unsigned long long) map.size);
+	  logindex_close(&idx);
+     } else if (q->verbose) {
+	  fprintf(stderr, "No valid index file, scanning whole log file\n");
+     }
+
+     query_csv_range(q, map.data+begin, map.data+end);
+     
+     csvlog_map_close(&map);
+
+     return 0;
+}
+
+/**
+ * Evaluate the query over a columnar file. Row groups are skipped
+ * according to their statistics.
+ *
+ * @return 0 on success, or -1 in case of an error.
+ */
+int query_colstore(struct query *q, const char *colfile)
+{
+     struct colstore_reader r;
+     if (colstore_reader_open(&r, colfile) == -1) {
+	  fprintf(stderr, "Could not open columnar file\n");
+	  return -1;
+     }
+
+     struct log_record *rows = malloc(r.group_rows*sizeof(struct log_record));
+     if (rows == NULL) {
+	  perror("Could not allocate memory");
+	  colstore_reader_close(&r);
+	  return -1;
+     }
+
+     int status;
+     struct colstore_group_header h;
+     while ((status = colstore_next_group(&r, &h)) == 1) {
+	  q->blocks++;
+	  /* As long as the start of the time range is unknown, row groups
+	     can only be skipped by epoch, since they might contain the
+	     first record of the selected epoch. */
+	  struct record_filter fskip = q->f;
+	  if (!q->has_start) {
+	       record_filter_init(&fskip);
+	       fskip.epoch_min = q->f.epoch_min;
+	       fskip.epoch_max = q->f.epoch_max;
+	  }
+	  if (!colstore_group_overlaps(&h, &fskip)) {
+	       q->blocks_skipped++;
+	       if (colstore_skip_group(&r, &h) == -1) {
+		    status = -1;
+		    break;
+	       }
+	       continue;
+	  }
+	  if (colstore_read_group(&r, &h, rows) == -1) {
+	       status = -1;
+	       break;
+	  }
+	  for (uint32_t i = 0; i < h.rows; i++)
+	       query_add(q, &rows[i]);
+     }
+
+     if (status == -1)
+	  fprintf(stderr, "Corrupted columnar file\n");
+     else if (q->verbose)
+	  fprintf(stderr, "Skipped %lu of %lu row groups\n", q->blocks_skipped,
+		  q->blocks);
+
+     free(rows);
+     colstore_reader_close(&r);
+
+     return (status == -1 ? -1 : 0);
+}
+
+/**
+ * Check whether a file is a columnar file.
+ */
+bool is_colstore(const char *path)
+{
+     FILE *f = fopen(path, "r");
+     if (f == NULL)
+	  return false;
+
+     char magic[sizeof(COLSTORE_MAGIC)];
+     bool result = (fread(magic, sizeof(magic), 1, f) == 1 &&
+		    memcmp(magic, COLSTORE_MAGIC, sizeof(magic)) == 0);
+     fclose(f);
+
+     return result;
+}
+
+/**
+ * Parse a comma-separated list of aggregates.
+ *
+ * @return 0 on success, or -1 if the list contains unknown aggregates.
+ */
+int parse_aggregates(struct query *q, const char *list)
+{
+     q->naggs = 0;
+
+     const char *p = list;
+     while (*p != '\0') {
+	  size_t len = strcspn(p, ",");
+	  int agg;
+	  for (agg = 0; agg < AGG_NUM; agg++) {
+	       if (strlen(aggregate_names[agg]) == len &&
+		   strncmp(p, aggregate_names[agg], len) == 0)
+		    break;
+	  }
+	  if (agg == AGG_NUM || q->naggs == AGG_NUM)
+	       return -1;
+	  q->aggs[q->naggs++] = agg;
+	  p += len;
+	  if (*p == ',')
+	       p++;
+     }
+     
+     return 0;
+}
+
+/**
+ * Convert seconds given as string to nanoseconds.
+ */
+uint64_t seconds_to_nanosec(const char *s)
+{
+     return (uint64_t) (strtod(s, NULL)*1000000000.0 + 0.5);
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     struct query q;
+     memset(&q, 0, sizeof(q));
+     record_filter_init(&q.f);
+     q.t1 = UINT64_MAX;
+     for (int i = 0; i < AGG_NUM; i++)
+	  q.aggs[q.naggs++] = i;
+     char *indexfile_arg = NULL;
+     struct leakage_model leakage;
+
+     static struct option long_options[] = {
+	  {"epoch", required_argument, NULL, 'e'},
+	  {"min", required_argument, NULL, 'l'},
+	  {"max", required_argument, NULL, 'u'},
+	  {"t0", required_argument, NULL, 's'},
+	  {"t1", required_argument, NULL, 't'},
+	  {"agg", required_argument, NULL, 'a'},
+	  {"index", required_argument, NULL, 'i'},
+	  {"leakage", required_argument, NULL, 'c'},
+	  {"verbose", no_argument, NULL, 'v'},
+	  {NULL, 0, NULL, 0}
+     };
+     int c;
+     while ((c = getopt_long(argc, argv, "e:l:u:s:t:a:i:c:v", long_options,
+			     NULL)) != -1) {
+	  switch (c) {
+	  case 'e' :
+	       q.f.epoch_min = q.f.epoch_max = strtoull(optarg, NULL, 10);
+	       break;
+	  case 'l' :
+	       q.f.value_min = atoi(optarg);
+	       break;
+	  case 'u' :
+	       q.f.value_max = atoi(optarg);
+	       break;
+	  case 's' :
+	       q.t0 = seconds_to_nanosec(optarg);
+	       q.has_time_range = true;
+	       break;
+	  case 't' :
+	       q.t1 = seconds_to_nanosec(optarg);
+	       q.has_time_range = true;
+	       break;
+	  case 'a' :
+	       if (parse_aggregates(&q, optarg) == -1) {
+		    fprintf(stderr, "Unknown aggregate\n");
+		    usage(argv[0]);
+		    exit(-1);
+	       }
+	       break;
+	  case 'i' :
+	       indexfile_arg = optarg;
+	       break;
+	  case 'c' :
+	       if (leakage_load(&leakage, optarg) == -1) {
+		    fprintf(stderr, "Could not read leakage model\n");
+		    exit(-1);
+	       }
+	       q.leakage = &leakage;
+	       break;
+	  case 'v' :
+	       q.verbose = true;
+	       break;
+	  case '?' :
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc-1) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+     const char *logfile = argv[optind];
+
+     /* By default, the index file is stored next to the log file. */
+     char *indexfile;
+     if (indexfile_arg != NULL) {
+	  indexfile = indexfile_arg;
+     } else {
+	  indexfile = malloc(strlen(logfile)+strlen(".idx")+1);
+	  strcpy(indexfile, logfile);
+	  strcat(indexfile, ".idx");
+     }
+
+     int status;
+     if (is_colstore(logfile))
+	  status = query_colstore(&q, logfile);
+     else
+	  status = query_csv(&q, logfile, indexfile);
+
+     /* Output format: comma-separated values
+	epoch, selected aggregates */
+     query_print(&q);
+
+     return status;
+}
@@ -0,0 +1,135 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "streamsrv.h"
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-r RATE] [-e EPOCH] [-n] SOCKETPATH\n", appl);
+}
+
+/**
+ * Read a complete record from the socket.
+ *
+ * @return true on success, or false if the connection has been closed.
+ */
+bool read_record(int fd, struct stream_record *rec)
+{
+     size_t received = 0;
+     while (received < sizeof(*rec)) {
+	  ssize_t n = read(fd, (char *) rec+received, sizeof(*rec)-received);
+	  if (n <= 0)
+	       return false;
+	  received += n;
+     }
+
+     return true;
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     struct stream_subscription sub;
+     memset(&sub, 0, sizeof(sub));
+     sub.flags = STREAM_SAMPLES | STREAM_SUMMARIES;
+     int c;
+     while ((c = getopt(argc, argv, "r:e:n")) != -1) {
+	  switch (c) {
+	  case 'r' : {
+	       double rate = strtod(optarg, NULL);
+	       if (rate <= 0.0) {
+		    usage(argv[0]);
+		    exit(-1);
+	       }
+	       sub.interval_ns = (uint64_t) (1000000000.0/rate+0.5);
+	       break;
+	  }
+	  case 'e' :
+	       sub.flags |= STREAM_EPOCH_FILTER;
+	       sub.epoch = strtoull(optarg, NULL, 10);
+	       break;
+	  case 'n' :
+	       sub.flags &= ~STREAM_SAMPLES;
+	       break;
+	  default :
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc-1) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+
+     struct sockaddr_un addr;
+     memset(&addr, 0, sizeof(addr));
+     addr.sun_family = AF_UNIX;
+     strncpy(addr.sun_path, argv[optind], sizeof(addr.sun_path)-1);
+
+     int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+     if (fd == -1 ||
+	 connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+	  perror("Could not connect to server");
+	  exit(-1);
+     }
+
+     if (write(fd, &sub, sizeof(sub)) != sizeof(sub)) {
+	  perror("Could not subscribe");
+	  exit(-1);
+     }
+
+     struct stream_record rec;
+     while (read_record(fd, &rec)) {
+	  switch (rec.type) {
+	  case STREAM_SAMPLES :
+	       printf("%llu,%llu,%u\n", (unsigned long long) rec.timestamp,
+		      (unsigned long long) rec.epoch, rec.value);
+	       break;
+	  case STREAM_SUMMARIES :
+	       printf("# epoch %llu: %u samples, %.6f s, %.9g J, %.9g W, "
+		      "%.9g W (fit)\n", (unsigned long long) rec.epoch,
+		      rec.value, rec.duration/1000000000.0, rec.energy,
+		      rec.power, rec.pfit);
+	       break;
+	  case STREAM_OVERRUN :
+	       fprintf(stderr, "Overrun: %u samples lost\n", rec.value);
+	       break;
+	  }
+	  fflush(stdout);
+     }
+
+     close(fd);
+
+     return 0;
+}
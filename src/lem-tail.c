@@ -0,0 +1,97 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "shmring.h"
+
+/* Polling interval of the reader. Readers poll, so they can never block the
+   logger. */
+#define POLL_INTERVAL_NS 10000000
+
+/**
+ * Print usage information.
+ */
+void usage(const char *appl)
+{
+     fprintf(stderr, "%s [-b] SHMNAME\n", appl);
+}
+
+/**
+ * The main function.
+ */
+int main(int argc, char *argv[])
+{
+     /* Parse command line arguments */
+
+     bool from_oldest = false;
+     int c;
+     while ((c = getopt(argc, argv, "b")) != -1) {
+	  switch (c) {
+	  case 'b' :
+	       from_oldest = true;
+	       break;
+	  default :
+	       usage(argv[0]);
+	       exit(-1);
+	  }
+     }
+
+     if (optind != argc-1) {
+	  usage(argv[0]);
+	  exit(-1);
+     }
+
+     struct shmring_reader r;
+     if (shmring_reader_open(&r, argv[optind], from_oldest) == -1) {
+	  perror("Could not attach to shared-memory ring");
+	  exit(-1);
+     }
+
+     struct timespec poll_interval;
+     poll_interval.tv_sec = 0;
+     poll_interval.tv_nsec = POLL_INTERVAL_NS;
+     uint64_t lost = 0;
+     while (true) {
+	  /* All samples published before the ring was closed are read
+	     below. */
+	  bool closed = shmring_reader_closed(&r);
+	  struct ring_entry e;
+	  while (shmring_reader_next(&r, &e)) {
+	       if (r.lost != lost) {
+		    fprintf(stderr, "Overrun: %llu samples lost\n",
+			    (unsigned long long) (r.lost-lost));
+		    lost = r.lost;
+	       }
+	       printf("%llu,%llu,%d\n", (unsigned long long) e.timestamp,
+		      (unsigned long long) e.epoch, e.value);
+	  }
+	  if (closed)
+	       break;
+	  fflush(stdout);
+	  nanosleep(&poll_interval, NULL);
+     }
+
+     shmring_reader_close(&r);
+     
+     return 0;
+}
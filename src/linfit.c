@@ -0,0 +1,107 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "linfit.h"
+#include "energy.h"
+
+#include <math.h>
+
+void linfit_init(struct linfit *f)
+{
+     f->n = 0;
+     f->mean_x = 0.0;
+     f->mean_y = 0.0;
+     f->m2_x = 0.0;
+     f->m2_y = 0.0;
+     f->c_xy = 0.0;
+}
+
+void linfit_add(struct linfit *f, double x, double y)
+{
+     f->n++;
+
+     double dx = x-f->mean_x;
+     double dy = y-f->mean_y;
+     f->mean_x += dx/f->n;
+     f->mean_y += dy/f->n;
+     
+     f->m2_x += dx*(x-f->mean_x);
+     f->m2_y += dy*(y-f->mean_y);
+     f->c_xy += dx*(y-f->mean_y);
+}
+
+void linfit_add_run(struct linfit *f, double x0, double dx, uint64_t n,
+		    double y)
+{
+     if (n == 0)
+	  return;
+
+     /* Merge the moments of the run (mean and sum of squared deviations of
+	evenly spaced x; y is constant) with the moments of the fit. */
+     double n_run = (double) n;
+     double mean_x_run = x0 + 0.5*(n_run-1.0)*dx;
+     double m2_x_run = dx*dx*n_run*(n_run*n_run-1.0)/12.0;
+
+     double n_total = (double) (f->n+n);
+     double w = (double) f->n*n_run/n_total;
+     double delta_x = mean_x_run-f->mean_x;
+     double delta_y = y-f->mean_y;
+     f->mean_x += delta_x*n_run/n_total;
+     f->mean_y += delta_y*n_run/n_total;
+     f->m2_x += m2_x_run + delta_x*delta_x*w;
+     f->m2_y += delta_y*delta_y*w;
+     f->c_xy += delta_x*delta_y*w;
+     f->n += n;
+}
+
+double linfit_slope(const struct linfit *f)
+{
+     if (f->n < 2 || f->m2_x == 0.0)
+	  return 0.0;
+
+     return f->c_xy/f->m2_x;
+}
+
+double linfit_intercept(const struct linfit *f)
+{
+     return f->mean_y - linfit_slope(f)*f->mean_x;
+}
+
+double linfit_slope_stderr(const struct linfit *f)
+{
+     if (f->n < 3 || f->m2_x == 0.0)
+	  return 0.0;
+
+     /* Sum of squared residuals */
+     double ssr = f->m2_y - f->c_xy*f->c_xy/f->m2_x;
+     if (ssr < 0.0)
+	  ssr = 0.0;
+
+     return sqrt(ssr/(f->n-2)/f->m2_x);
+}
+
+double linfit_power(const struct linfit *f)
+{
+     return -0.5*CAPACITANCE*linfit_slope(f);
+}
+
+double linfit_power_ci95(const struct linfit *f)
+{
+     return LINFIT_Z95*0.5*CAPACITANCE*linfit_slope_stderr(f);
+}
@@ -0,0 +1,122 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LINFIT_H
+#define LINFIT_H
+
+#include <stdint.h>
+
+/* Quantile of the standard normal distribution for 95 % confidence
+   intervals. Since fits are calculated from many samples, the normal
+   distribution is used instead of Student's t-distribution. */
+#define LINFIT_Z95 1.959964
+
+/**
+ * Streaming least-squares fit of a line y = a + b*x.
+ *
+ * Means and (co-)moments are updated incrementally (Welford's method), so
+ * the fit needs constant memory and is numerically stable also for many
+ * samples.
+ */
+struct linfit {
+     uint64_t n;
+
+     double mean_x;
+     double mean_y;
+
+     /* Sum of squared deviations of x and y, and sum of products of
+	deviations. */
+     double m2_x;
+     double m2_y;
+     double c_xy;
+};
+
+/**
+ * Initialize a fit without samples.
+ *
+ * @param f the fit
+ */
+void linfit_init(struct linfit *f);
+
+/**
+ * Add a sample.
+ *
+ * @param f the fit
+ * @param x the independent variable
+ * @param y the dependent variable
+ */
+void linfit_add(struct linfit *f, double x, double y);
+
+/**
+ * Add a run of n samples with identical y at evenly spaced x, i.e., at
+ * x0, x0+dx, ..., x0+(n-1)*dx. Equivalent to adding the samples one by
+ * one.
+ *
+ * @param f the fit
+ * @param x0 the independent variable of the first sample
+ * @param dx the spacing of the independent variable
+ * @param n the number of samples
+ * @param y the dependent variable
+ */
+void linfit_add_run(struct linfit *f, double x0, double dx, uint64_t n,
+		    double y);
+
+/**
+ * Slope of the fitted line.
+ *
+ * @param f the fit
+ * @return slope b, or 0 if less than two distinct x values were added.
+ */
+double linfit_slope(const struct linfit *f);
+
+/**
+ * Intercept of the fitted line.
+ *
+ * @param f the fit
+ * @return intercept a
+ */
+double linfit_intercept(const struct linfit *f);
+
+/**
+ * Standard error of the slope.
+ *
+ * @param f the fit
+ * @return standard error of b, or 0 if less than three samples were added.
+ */
+double linfit_slope_stderr(const struct linfit *f);
+
+/**
+ * Estimate the power consumption from a fit of the squared capacitor
+ * voltage over time. For constant power P, V^2 decreases linearly over
+ * time with slope -2*P/C.
+ *
+ * @param f the fit of V^2 [V^2] over time [s]
+ * @return power in Watt
+ */
+double linfit_power(const struct linfit *f);
+
+/**
+ * Half-width of the 95 % confidence interval of the power estimate.
+ *
+ * @param f the fit of V^2 [V^2] over time [s]
+ * @return power in Watt
+ */
+double linfit_power_ci95(const struct linfit *f);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "logindex.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int logindex_writer_open(struct logindex_writer *w, const char *path,
+			 uint64_t bucket_ns)
+{
+     w->f = fopen(path, "w");
+     if (w->f == NULL)
+	  return -1;
+
+     w->bucket_ns = bucket_ns;
+     w->has_entry = false;
+     w->last_epoch = 0;
+     w->next_bucket = 0;
+
+     struct logindex_header header;
+     memset(&header, 0, sizeof(header));
+     strcpy(header.magic, LOGINDEX_MAGIC);
+     header.bucket_ns = bucket_ns;
+     if (fwrite(&header, sizeof(header), 1, w->f) != 1) {
+	  fclose(w->f);
+	  w->f = NULL;
+	  return -1;
+     }
+
+     return 0;
+}
+
+int logindex_writer_add(struct logindex_writer *w, uint64_t offset,
+			uint64_t timestamp, uint64_t epoch)
+{
+     /* Comparing against the start of the next bucket avoids a 64 bit
+	division per record. */
+     if (w->has_entry && epoch == w->last_epoch && timestamp < w->next_bucket)
+	  return 0;
+
+     struct logindex_entry entry;
+     entry.offset = offset;
+     entry.timestamp = timestamp;
+     entry.epoch = epoch;
+     if (fwrite(&entry, sizeof(entry), 1, w->f) != 1)
+	  return -1;
+
+     w->has_entry = true;
+     w->last_epoch = epoch;
+     w->next_bucket = (timestamp/w->bucket_ns+1)*w->bucket_ns;
+
+     return 0;
+}
+
+int logindex_writer_close(struct logindex_writer *w)
+{
+     int status = 0;
+     
+     if (w->f != NULL && fclose(w->f) == EOF)
+	  status = -1;
+     w->f = NULL;
+
+     return status;
+}
+
+int logindex_open(struct logindex *idx, const char *path)
+{
+     int fd = open(path, O_RDONLY);
+     if (fd == -1)
+	  return -1;
+
+     struct stat st;
+     if (fstat(fd, &st) == -1 ||
+	 st.st_size < sizeof(struct logindex_header)) {
+	  close(fd);
+	  return -1;
+     }
+
+     void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (map == MAP_FAILED)
+	  return -1;
+
+     const struct logindex_header *header = map;
+     if (memcmp(header->magic, LOGINDEX_MAGIC, sizeof(LOGINDEX_MAGIC)) != 0) {
+	  munmap(map, st.st_size);
+	  return -1;
+     }
+
+     idx->map = map;
+     idx->mapsize = st.st_size;
+     idx->bucket_ns = header->bucket_ns;
+     idx->entries = (const struct logindex_entry *) (header+1);
+     /* A partially written last entry (e.g., after a crash) is ignored. */
+     idx->nentries = (st.st_size-sizeof(struct logindex_header))/
+	  sizeof(struct logindex_entry);
+     
+     return 0;
+}
+
+void logindex_close(struct logindex *idx)
+{
+     if (idx->map != NULL)
+	  munmap(idx->map, idx->mapsize);
+     idx->map = NULL;
+     idx->entries = NULL;
+     idx->nentries = 0;
+}
+
+size_t logindex_find_epoch(const struct logindex *idx, uint64_t epoch)
+{
+     size_t lo = 0;
+     size_t hi = idx->nentries;
+
+     while (lo < hi) {
+	  size_t mid = lo+(hi-lo)/2;
+	  if (idx->entries[mid].epoch < epoch)
+	       lo = mid+1;
+	  else
+	       hi = mid;
+     }
+
+     return lo;
+}
+
+size_t logindex_find_time(const struct logindex *idx, uint64_t t)
+{
+     size_t lo = 0;
+     size_t hi = idx->nentries;
+
+     /* Find first entry with a timestamp greater than t. */
+     while (lo < hi) {
+	  size_t mid = lo+(hi-lo)/2;
+	  if (idx->entries[mid].timestamp <= t)
+	       lo = mid+1;
+	  else
+	       hi = mid;
+     }
+
+     return (lo == 0 ? idx->nentries : lo-1);
+}
+
+void logindex_lookup(const struct logindex *idx,
+		     uint64_t epoch_min, uint64_t epoch_max,
+		     uint64_t t_min, uint64_t t_max, uint64_t logsize,
+		     uint64_t *begin, uint64_t *end)
+{
+     *begin = 0;
+     *end = logsize;
+     
+     if (idx->nentries == 0)
+	  return;
+
+     /* Every epoch starts with an index entry, so no record of an epoch
+	greater or equal to epoch_min is located before this entry. */
+     size_t i = logindex_find_epoch(idx, epoch_min);
+     if (i == idx->nentries) {
+	  /* Records of the last indexed epoch might follow the last entry
+	     in a log file that is still being written. */
+	  *begin = idx->entries[i-1].offset;
+     } else {
+	  *begin = idx->entries[i].offset;
+     }
+     
+     i = logindex_find_time(idx, t_min);
+     if (i != idx->nentries && idx->entries[i].offset > *begin)
+	  *begin = idx->entries[i].offset;
+
+     if (epoch_max < UINT64_MAX) {
+	  i = logindex_find_epoch(idx, epoch_max+1);
+	  if (i != idx->nentries && idx->entries[i].offset < *end)
+	       *end = idx->entries[i].offset;
+     }
+
+     if (t_max < UINT64_MAX) {
+	  i = logindex_find_time(idx, t_max);
+	  /* Records following the next entry have greater timestamps. */
+	  if (i == idx->nentries)
+	       *end = *begin;
+	  else if (i+1 < idx->nentries && idx->entries[i+1].offset < *end)
+	       *end = idx->entries[i+1].offset;
+     }
+
+     if (*end < *begin)
+	  *end = *begin;
+}
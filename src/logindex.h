@@ -0,0 +1,165 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Default width of time buckets (1 s). */
+#define LOGINDEX_BUCKET_NS 1000000000ull
+
+#define LOGINDEX_MAGIC "LEMIDX1"
+
+/**
+ * Header of an index file.
+ */
+struct logindex_header {
+     char magic[8];
+     uint64_t bucket_ns;
+};
+
+/**
+ * Entry of an index file pointing to the first record of a new epoch or
+ * time bucket in the log file.
+ *
+ * Since timestamps and epochs increase monotonically in the log file,
+ * entries are sorted by offset, timestamp, and epoch at the same time. 
+ */
+struct logindex_entry {
+     uint64_t offset;
+     uint64_t timestamp;
+     uint64_t epoch;
+};
+
+/**
+ * Writer creating an index file while a log file is written.
+ */
+struct logindex_writer {
+     FILE *f;
+     uint64_t bucket_ns;
+
+     bool has_entry;
+     uint64_t last_epoch;
+     uint64_t next_bucket;
+};
+
+/**
+ * An index file mapped into memory.
+ */
+struct logindex {
+     const struct logindex_entry *entries;
+     size_t nentries;
+     uint64_t bucket_ns;
+
+     void *map;
+     size_t mapsize;
+};
+
+/**
+ * Create a new index file.
+ *
+ * @param w the writer
+ * @param path path of the index file
+ * @param bucket_ns width of time buckets in nanoseconds
+ * @return 0 on success, or -1 in case of an error (errno is set).
+ */
+int logindex_writer_open(struct logindex_writer *w, const char *path,
+			 uint64_t bucket_ns);
+
+/**
+ * Announce a record written to the log file. An index entry is only
+ * written for the first record of an epoch or time bucket.
+ *
+ * @param w the writer
+ * @param offset offset of the record in the log file
+ * @param timestamp timestamp of the record
+ * @param epoch epoch of the record
+ * @return 0 on success, or -1 in case of an error.
+ */
+int logindex_writer_add(struct logindex_writer *w, uint64_t offset,
+			uint64_t timestamp, uint64_t epoch);
+
+/**
+ * Close an index file.
+ *
+ * @param w the writer
+ * @return 0 on success, or -1 in case of an error.
+ */
+int logindex_writer_close(struct logindex_writer *w);
+
+/**
+ * Open an existing index file.
+ *
+ * @param idx the index
+ * @param path path of the index file
+ * @return 0 on success, or -1 in case of an error or invalid index file.
+ */
+int logindex_open(struct logindex *idx, const char *path);
+
+/**
+ * Close an index file.
+ *
+ * @param idx the index
+ */
+void logindex_close(struct logindex *idx);
+
+/**
+ * Find the first entry of an epoch.
+ *
+ * @param idx the index
+ * @param epoch the epoch
+ * @return index of the first entry with an epoch greater or equal to the
+ * given epoch, or the number of entries if there is no such entry.
+ */
+size_t logindex_find_epoch(const struct logindex *idx, uint64_t epoch);
+
+/**
+ * Find the entry of the time bucket containing a timestamp.
+ *
+ * @param idx the index
+ * @param t timestamp
+ * @return index of the last entry with a timestamp less or equal to the
+ * given timestamp, or the number of entries if there is no such entry.
+ */
+size_t logindex_find_time(const struct logindex *idx, uint64_t t);
+
+/**
+ * Determine the range of the log file containing all records with epochs
+ * and timestamps in the given (inclusive) ranges. Lookups take O(log n)
+ * time for n index entries.
+ *
+ * @param idx the index
+ * @param epoch_min minimum epoch
+ * @param epoch_max maximum epoch
+ * @param t_min minimum timestamp
+ * @param t_max maximum timestamp
+ * @param logsize size of the log file
+ * @param begin offset of the beginning of the range
+ * @param end offset of the end of the range (exclusive)
+ */
+void logindex_lookup(const struct logindex *idx,
+		     uint64_t epoch_min, uint64_t epoch_max,
+		     uint64_t t_min, uint64_t t_max, uint64_t logsize,
+		     uint64_t *begin, uint64_t *end);
+
+#endif
@@ -24,11 +24,28 @@
 #include <time.h>
 #include <stdbool.h>
 #include <signal.h>
+#include <errno.h>
 #include <sched.h>
+#include <getopt.h>
 #include <sys/mman.h>
 #include <stdbool.h>
 #include "mcp320x.h"
 #include "ring.h"
+#include "timing.h"
+#include "csvlog.h"
+#include "logindex.h"
+#include "powermon.h"
+#include "burst.h"
+#include "shmring.h"
+#include "streamsrv.h"
+#include "stats.h"
+#include "simadc.h"
+#include "energy.h"
+#include "clocksrc.h"
+#include "flightrec.h"
+#include "cpumon.h"
+#include "rtcheck.h"
+#include "histogram.h"
 
 /* Default task priority */
 #define DEFAULT_TASK_PRIORITY 49
@@ -36,6 +53,67 @@
 /* Estimated maximum stack size */
 #define MAX_STACK_SIZE (RING_SIZE*sizeof(struct ring_entry) + 1024) 
 
+/* Adaptive sampling rate: the rate is halved after ADAPT_WINDOW samples
+   if the ADC count changed by less than ADAPT_STEP_COUNTS, and doubled
+   otherwise. A jump of ADAPT_STEP_COUNTS between two consecutive samples
+   (burst) immediately switches to the maximum rate. */
+#define ADAPT_STEP_COUNTS 4
+#define ADAPT_WINDOW 16
+#define MAX_RATE_LEVELS 32
+
+/* Interval of power monitor reports (1 s) */
+#define MONITOR_INTERVAL_NS 1000000000ull
+
+/* Maximum number of entries taken from the ring at once by the logger. */
+#define LOGGER_BATCH 64
+
+/* Relay transitions (break-before-make): after opening one relay, the
+   other relay is closed after at least RELAY_BREAK_MIN_NS, which is twice
+   the maximum release time of 10 ms according to the datasheet. Before, the
+   ADC trace must have settled (stayed within RELAY_SETTLE_COUNTS for
+   RELAY_SETTLE_NS), but the other relay is closed after RELAY_BREAK_MAX_NS
+   in any case. During transitions, samples are taken at least every
+   RELAY_SAMPLING_INTERVAL_NS. */
+#define RELAY_BREAK_MIN_NS 20000000ull
+#define RELAY_BREAK_MAX_NS 100000000ull
+#define RELAY_SETTLE_NS 5000000ull
+#define RELAY_SETTLE_COUNTS 6
+#define RELAY_SAMPLING_INTERVAL_NS 1000000l
+
+/* While charging, the capacitor voltage is polled after half of the
+   predicted time to reach the upper threshold, but at least every
+   CHARGE_POLL_MAX_NS, and at the sampling rate close to the threshold. */
+#define CHARGE_POLL_FRACTION 0.5
+#define CHARGE_POLL_MAX_NS 100000000ull
+
+/* Default duration of the calibration [s] and default target rate of
+   deadline misses. */
+#define CALIBRATION_SECONDS 10.0
+#define CALIBRATION_MISS_RATE 0.0001
+
+/* Long options without short option. */
+#define OPT_CALIBRATE 256
+#define OPT_MISS_RATE 257
+#define OPT_SIMULATE 258
+#define OPT_RT_CHECK 259
+
+/* Default check interval of the real-time safety checker [s]. */
+#define RTCHECK_SECONDS 1.0
+
+/* Polling interval of the flight recorder thread [ns]. */
+#define FLIGHTREC_POLL_NS 10000000l
+
+/* Polling interval of the thread reporting real-time safety violations
+   [ns]. */
+#define RTCHECK_POLL_NS 100000000l
+
+/* Size of the buffer of CPU monitor annotations waiting to be written to
+   the log file. */
+#define ANNOTATION_BUFFER_SIZE 4096
+
+/* Maximum number of rounds of the stress test. */
+#define STRESS_MAX_ROUNDS 20
+
 /* GPIO pins controlling charge and discharge relay */
 const RPiGPIOPin charge_pin = RPI_GPIO_P1_18; 
 const RPiGPIOPin discharge_pin = RPI_GPIO_P1_16; 
@@ -52,10 +130,95 @@ const bcm2835SPIChipSelect spi_cs = BCM2835_SPI_CS0;
 const unsigned int spi_frequency = 500000;
 
 FILE *fout = NULL;
+/* Offset of the next record in the log file for indexing. */
+uint64_t log_offset = 0;
+
+/* Change-only logging: a record is only written when the ADC count changes,
+   at epoch boundaries, or after the keepalive interval. */
+bool is_change_only = false;
+uint64_t keepalive_ns;
+
+/**
+ * Run of consecutive samples with identical ADC count.
+ */
+struct run {
+     bool pending;
+     uint64_t t_first;
+     uint64_t t_last;
+     uint64_t epoch;
+     uint16_t value;
+     uint32_t count;
+};
+
+struct run the_run;
+
+/* Tick log: samples are identified by their tick of the sampling schedule
+   of their epoch; a timestamp is only written if the sample deviates from
+   the schedule by more than tick_tolerance_ns. */
+bool is_tick_log = false;
+uint64_t tick_tolerance_ns;
+struct csvlog_tick_state the_tick_log;
+
+struct logindex_writer the_index;
+bool is_index_open = false;
+
+FILE *fmonitor = NULL;
+struct powermon the_powermon;
+
+FILE *fevents = NULL;
+struct burst_detector the_burst_detector;
+
+struct shmring_writer the_shmring;
+bool is_shmring_open = false;
+
+struct streamsrv the_streamsrv;
+bool is_streamsrv_open = false;
+
+struct stats the_stats;
+/* Interval of the periodic statistics line and statistics file updates. */
+struct timespec stats_interval;
+bool is_stats_line = false;
+char *statsfile = NULL;
+char *statsfile_tmp = NULL;
 
 int task_priority;
 struct timespec sampling_interval;
 double sampling_frequency;
+/* Drift-free schedule of samples while discharging. */
+struct schedule the_schedule;
+
+/* Levels of adaptive sampling. Level 0 is the maximum rate
+   (sampling_frequency); each further level halves the rate, i.e., level l
+   samples every 2^l ticks of the schedule. */
+bool is_adaptive = false;
+unsigned int rate_levels = 1;
+
+/**
+ * State of adaptive sampling rate control.
+ */
+struct rate_control {
+     unsigned int level;
+     int16_t last;
+     int16_t ref;
+     unsigned int nsamples;
+};
+
+/**
+ * State of a relay transition.
+ */
+struct relay_transition {
+     /* Time the relay was opened */
+     uint64_t t_open;
+     /* Window of samples within RELAY_SETTLE_COUNTS */
+     bool has_window;
+     uint64_t t_window;
+     int16_t window_min;
+     int16_t window_max;
+};
+
+/* Log of samples taken during relay transitions. */
+FILE *ftransitions = NULL;
+bool is_transition_log = false;
 
 uint16_t threshold_upper;
 uint16_t threshold_lower;
@@ -64,10 +227,88 @@ struct ring the_ring;
 
 pthread_t sampling_thread;
 pthread_t logger_thread;
+pthread_t stats_thread;
 
 bool is_spi_open = false;
 bool is_bcm_open = false;
 
+/* Synthetic ADC instead of measurement board (stress test, or option
+   --simulate). */
+bool is_simulated = false;
+struct simadc the_simadc;
+
+/* Stress test: sampling rate doubled by the main thread every round, i.e.,
+   the sampling rate is sampling_frequency*2^stress_level. */
+bool is_stress = false;
+uint32_t stress_level;
+struct timespec stress_round;
+
+/* Set by the SIGINT handler after cancelling sampling and logger thread. */
+volatile sig_atomic_t is_interrupted = 0;
+
+/* Warm start: if the capacitor is still charged above the lower threshold
+   at startup, e.g., from a previous run, the first epoch starts without
+   charging first. */
+bool is_cold_start = false;
+bool is_warm_start = false;
+/* Start time of the process, for reporting the time to the first sample. */
+uint64_t t_start_ns;
+
+/* Timestamps of the sampling thread, optionally from the hardware counter
+   of the CPU. Only used by the sampling thread; the hardware counter is
+   re-calibrated by a thread with normal priority. */
+bool is_counter_clock = false;
+struct clocksrc the_clocksrc;
+pthread_t clocksrc_thread;
+
+/* Flight recorder of the sampling loop, dumped to flightfile whenever the
+   sampling thread wakes up later than flightrec_lateness_ns (or one
+   sampling interval if 0) after the scheduled sampling time. */
+bool is_flightrec = false;
+struct flightrec the_flightrec;
+uint64_t flightrec_lateness_ns = 0;
+FILE *fflight = NULL;
+pthread_t flightrec_thread;
+
+/* Calibration: distributions of the wakeup latency of the sampling thread,
+   the time from wakeup to the end of an iteration of the sampling loop
+   (loop cost), and their sum (busy time). */
+bool is_calibration = false;
+struct timespec calibration_duration;
+double calibration_miss_rate = CALIBRATION_MISS_RATE;
+struct histogram hist_latency;
+struct histogram hist_cost;
+struct histogram hist_busy;
+/* Iterations in the histograms while charging and while discharging. */
+uint64_t calibration_charging;
+uint64_t calibration_discharging;
+
+/* Real-time safety checker of the sampling thread. Violations are
+   reported by a thread with normal priority. */
+bool is_rtcheck = false;
+struct rtcheck the_rtcheck;
+pthread_t rtcheck_thread;
+
+/* CPU the sampling thread is pinned to, or -1 if not pinned. */
+int sampler_cpu = -1;
+
+/* CPU monitor: annotates changes of CPU frequency, throttling state, and
+   temperature in the log file. The monitor thread appends annotations to
+   the buffer, the logger thread writes them between samples without ever
+   waiting for the monitor. */
+bool is_cpumon = false;
+struct cpumon the_cpumon;
+struct timespec cpumon_interval;
+pthread_t cpumon_thread;
+pthread_mutex_t annotation_mutex = PTHREAD_MUTEX_INITIALIZER;
+char annotations[ANNOTATION_BUFFER_SIZE];
+size_t annotation_len = 0;
+
+/* Number of entries of the ring between sampling and logger thread. */
+unsigned int ring_size = RING_SIZE;
+
+void flush_run(bool end_of_epoch);
+
 /**
  * Gracefully terminate the process.
  *
@@ -75,8 +316,39 @@ bool is_bcm_open = false;
  */
 void die(int status)
 {
-     if (fout != NULL)
+     if (fout != NULL) {
+	  if (is_change_only)
+	       flush_run(true);
 	  fclose(fout);
+     }
+
+     if (is_index_open)
+	  logindex_writer_close(&the_index);
+
+     if (fmonitor != NULL)
+	  fclose(fmonitor);
+     if (is_shmring_open)
+	  shmring_writer_close(&the_shmring);
+     if (is_streamsrv_open)
+	  streamsrv_close(&the_streamsrv);
+
+     if (fevents != NULL)
+	  fclose(fevents);
+
+     if (ftransitions != NULL)
+	  fclose(ftransitions);
+
+     if (fflight != NULL)
+	  fclose(fflight);
+
+     cpumon_restore_governor(&the_cpumon);
+
+     if (is_rtcheck)
+	  fprintf(stderr, "RT check: %llu of %llu intervals violated\n",
+		  (unsigned long long) __atomic_load_n(&the_rtcheck.violations,
+						       __ATOMIC_RELAXED),
+		  (unsigned long long) __atomic_load_n(&the_rtcheck.intervals,
+						       __ATOMIC_RELAXED));
 
      if (is_spi_open)
 	  bcm2835_spi_end();
@@ -92,6 +364,7 @@ void die(int status)
  */
 void sig_int(int signo)
 {
+     is_interrupted = 1;
      pthread_cancel(sampling_thread);
      pthread_cancel(logger_thread);
 }
@@ -102,7 +375,16 @@ void sig_int(int signo)
 void usage(const char *appl)
 {
      fprintf(stderr, "%s -f SAMPLING_FREQUENCY -l LOWER_THRESHOLD "
-	     "-u UPPER_THRESHOLD -o LOGFILE [-p TASK_PRIORITY] \n", appl);
+	     "-u UPPER_THRESHOLD -o LOGFILE [-p TASK_PRIORITY] [-i INDEXFILE] "
+	     "[-m MONITORFILE] [-e EVENTFILE] [-a MIN_SAMPLING_FREQUENCY] "
+	     "[-c KEEPALIVE_SECONDS] [-s SHMNAME] [-U SOCKETPATH] "
+	     "[-S STATS_INTERVAL_SECONDS] [-T STATSFILE] [-R RING_SIZE] "
+	     "[-x STRESS_ROUND_SECONDS] [-t TRANSITIONFILE] [-C] [-H] "
+	     "[-k TICK_TOLERANCE_MICROSECONDS] [-J FLIGHTFILE] "
+	     "[-j LATENESS_MICROSECONDS] [-A CPU] "
+	     "[-F MONITOR_INTERVAL_SECONDS] [-G] [--simulate] "
+	     "[--calibrate[=SECONDS]] [--miss-rate=RATE] "
+	     "[--rt-check[=SECONDS]]\n", appl);
 }
 
 /**
@@ -116,76 +398,412 @@ void stack_prefault(void)
 }
 
 /**
- * Convert a frequency value to a time interval.
+ * Write a sample taken during a relay transition as CSV to the transition
+ * log.
  *
- * @param frequency frequency in Hertz
- * @return time interval
+ * Format: comma-separated values
+ * timestamp [nanoseconds], epoch, direction (D: to discharging, C: to
+ * charging), value
+ *
+ * @param f transition log
+ * @param e the sample
  */
-struct timespec frequency_to_interval(double frequency)
+void log_transition(FILE *f, const struct ring_entry *e)
 {
-     struct timespec itimespec;
-     
-     /* Calculate interval in nanoseconds.
-        A 64 bit value is enough for thousands of years sampling. */
-     uint64_t ins = (uint64_t) (1000000000.0/frequency + 0.5);
+     fprintf(f, "%llu,%llu,%c,%d\n", (unsigned long long) e->timestamp,
+	     (unsigned long long) e->epoch,
+	     e->type == RING_ENTRY_TO_DISCHARGING ? 'D' : 'C', e->value);
+}
 
-     itimespec.tv_sec = ins/1000000000ull;
-     itimespec.tv_nsec = ins%1000000000ull;
+/**
+ * Write a record to the log file and the index file.
+ *
+ * @param t timestamp
+ * @param epoch epoch
+ * @param value sample value
+ * @param count number of samples (change-only logging only)
+ */
+void write_record(uint64_t t, uint64_t epoch, uint16_t value, uint32_t count)
+{
+     if (is_index_open &&
+	 logindex_writer_add(&the_index, log_offset, t, epoch) == -1) {
+	  perror("Could not write index file");
+	  logindex_writer_close(&the_index);
+	  is_index_open = false;
+     }
 
-     return itimespec;
+     int len;
+     if (is_change_only)
+	  len = csvlog_write_run(fout, t, epoch, value, count);
+     else
+	  len = csvlog_write_sample(fout, t, epoch, value);
+     if (len > 0)
+	  log_offset += len;
 }
 
 /**
- * Calculate timestamp of next sample.
+ * Write a sample to the tick log. The tick of the ring entry holds the
+ * lower 32 bits of the tick only.
  *
- * @param tlast time of last sample
- * @param interval sampling interval
- * @return time of next sample
+ * @param e the sample
  */
-struct timespec next_sampling_time(struct timespec tlast,
-				   struct timespec interval)
+void log_tick(const struct ring_entry *e)
 {
-     struct timespec tnext;
+     struct csvlog_tick_state *s = &the_tick_log;
+     uint64_t tick = s->last + (uint32_t) (e->tick-(uint32_t) s->last);
      
-     tnext.tv_sec = tlast.tv_sec+interval.tv_sec;
-     tnext.tv_nsec = tlast.tv_nsec+interval.tv_nsec;
+     csvlog_write_tick(fout, s, e->timestamp, e->epoch, tick, e->value,
+		       tick_tolerance_ns);
+}
+
+/**
+ * Write the pending run of samples. At the end of an epoch, the last
+ * sample of the run is written as separate record, so the timestamp of
+ * the last sample of the epoch is preserved.
+ *
+ * @param end_of_epoch true if the run is the last run of an epoch
+ */
+void flush_run(bool end_of_epoch)
+{
+     struct run *r = &the_run;
+
+     if (!r->pending)
+	  return;
 
-     /* Normalize */
-     if (tnext.tv_nsec >= 1000000000l) {
-	  tnext.tv_sec++;
-	  tnext.tv_nsec -= 1000000000l;
+     if (end_of_epoch && r->count > 1) {
+	  write_record(r->t_first, r->epoch, r->value, r->count-1);
+	  write_record(r->t_last, r->epoch, r->value, 1);
+     } else {
+	  write_record(r->t_first, r->epoch, r->value, r->count);
      }
+     
+     r->pending = false;
+}
+
+/**
+ * Add a sample to the current run of samples, writing the run if the
+ * sample starts a new one.
+ *
+ * @param e the sample
+ */
+void log_change(const struct ring_entry *e)
+{
+     struct run *r = &the_run;
+
+     if (r->pending) {
+	  if (e->epoch != r->epoch)
+	       flush_run(true);
+	  else if (e->value != r->value ||
+		   e->timestamp-r->t_first >= keepalive_ns)
+	       flush_run(false);
+     }
+
+     if (r->pending) {
+	  r->count++;
+	  r->t_last = e->timestamp;
+     } else {
+	  r->pending = true;
+	  r->t_first = e->timestamp;
+	  r->t_last = e->timestamp;
+	  r->epoch = e->epoch;
+	  r->value = e->value;
+	  r->count = 1;
+     }
+}
+
+/**
+ * Write the latest power estimates of the sliding windows as CSV to the
+ * monitor file.
+ *
+ * Format: comma-separated values
+ * timestamp [nanoseconds], epoch, power of each window [W], time covered
+ * by each window [s]
+ *
+ * @param fmonitor monitor file
+ * @param pm power monitor
+ * @param t timestamp of the latest sample
+ * @param epoch epoch of the latest sample
+ */
+void log_power(FILE *fmonitor, const struct powermon *pm, uint64_t t,
+	       uint64_t epoch)
+{
+     fprintf(fmonitor, "%llu,%llu", (unsigned long long) t,
+	     (unsigned long long) epoch);
+     for (int i = 0; i < POWERMON_WINDOWS; i++)
+	  fprintf(fmonitor, ",%.6g", powermon_power(pm, i));
+     for (int i = 0; i < POWERMON_WINDOWS; i++)
+	  fprintf(fmonitor, ",%.3f", powermon_span(pm, i));
+     fprintf(fmonitor, "\n");
+}
 
-     return tnext;
+/**
+ * Write an activity burst as CSV to the event file.
+ *
+ * Format: comma-separated values
+ * start timestamp [nanoseconds], epoch, duration [s], energy [J],
+ * idle power [W]
+ *
+ * @param fevents event file
+ * @param event the burst
+ */
+void log_burst(FILE *fevents, const struct burst_event *event)
+{
+     fprintf(fevents, "%llu,%llu,%.6f,%.6g,%.6g\n",
+	     (unsigned long long) event->t_start,
+	     (unsigned long long) event->epoch,
+	     (event->t_end-event->t_start)/1000000000.0, event->energy,
+	     event->idle_power);
 }
 
 /**
- * Convert timespec values (sec, ns) to 64 bit nanosecond value.
+ * Write the pending annotations of the CPU monitor to the log file. Skipped
+ * while the monitor thread appends annotations, so the logger thread never
+ * waits for the monitor thread.
+ */
+void write_annotations(void)
+{
+     if (__atomic_load_n(&annotation_len, __ATOMIC_RELAXED) == 0 ||
+	 pthread_mutex_trylock(&annotation_mutex) != 0)
+	  return;
+
+     log_offset += fwrite(annotations, 1, annotation_len, fout);
+     __atomic_store_n(&annotation_len, 0, __ATOMIC_RELAXED);
+
+     pthread_mutex_unlock(&annotation_mutex);
+}
+
+/**
+ * Reset adaptive sampling rate to the maximum rate.
  *
- * @param t timespec values
- * @return value in nanoseconds corresponding to timespec values
+ * @param rc rate control state
+ * @param sample the current sample
  */
-uint64_t to_nanosec(struct timespec t)
+void rate_control_reset(struct rate_control *rc, int16_t sample)
 {
-     uint64_t t_ns = 1000000000ull*t.tv_sec;
-     t_ns += t.tv_nsec;
+     rc->level = 0;
+     rc->last = sample;
+     rc->ref = sample;
+     rc->nsamples = 0;
+}
 
-     return t_ns;
+/**
+ * Adapt the sampling rate to the slope of the discharge curve: raise the
+ * rate when the voltage changes quickly and lower it during slow, flat 
+ * discharge.
+ *
+ * @param rc rate control state
+ * @param sample the current sample
+ */
+void rate_control_update(struct rate_control *rc, int16_t sample)
+{
+     if (abs(sample-rc->last) >= ADAPT_STEP_COUNTS) {
+	  rate_control_reset(rc, sample);
+	  return;
+     }
+     rc->last = sample;
+
+     if (abs(sample-rc->ref) >= ADAPT_STEP_COUNTS) {
+	  if (rc->level > 0)
+	       rc->level--;
+	  rc->ref = sample;
+	  rc->nsamples = 0;
+     } else if (++rc->nsamples == ADAPT_WINDOW) {
+	  if (rc->level+1 < rate_levels)
+	       rc->level++;
+	  rc->ref = sample;
+	  rc->nsamples = 0;
+     }
 }
 
 /**
- * Write timestamped samples as CSV to log file.
+ * Take a sample from the ADC, or from the synthetic ADC.
  *
- * Format: comma-separated values 
- * timestamp [nanoseconds], value 
+ * @return ADC count, or -1 in case of an error
+ */
+int16_t take_sample(void)
+{
+     if (is_simulated)
+	  return simadc_sample(&the_simadc);
+     else
+	  return get_sample_singleended(adc_channel);
+}
+
+/**
+ * Open or close a relay, or the relay of the synthetic ADC.
  *
- * @param fout output file
- * @param sample sample value
- * @param tsample timestamp of sample
+ * @param pin GPIO pin of the relay
+ * @param closed true to close the relay
  */
-void log_sample(FILE *fout, int16_t sample, uint64_t t, uint64_t epoch)
+void set_relay(RPiGPIOPin pin, bool closed)
 {
-     fprintf(fout, "%llu,%llu,%d\n", t, epoch, sample);
+     if (is_simulated)
+	  simadc_set_relay(&the_simadc, pin == charge_pin, closed);
+     else if (closed)
+	  bcm2835_gpio_set(pin);
+     else
+	  bcm2835_gpio_clr(pin);
+}
+
+/**
+ * Start a relay transition after opening a relay.
+ *
+ * @param rt the transition
+ */
+void relay_transition_start(struct relay_transition *rt)
+{
+     // Take the time after opening the relay, so the break time is never
+     // overestimated.
+     rt->t_open = clocksrc_now(&the_clocksrc);
+     rt->has_window = false;
+     rt->t_window = rt->t_open;
+     rt->window_min = 0;
+     rt->window_max = 0;
+}
+
+/**
+ * Update a relay transition with a sample taken while both relays are open.
+ *
+ * The other relay may be closed after the minimum break time if the ADC
+ * trace has settled, i.e., stayed within RELAY_SETTLE_COUNTS for
+ * RELAY_SETTLE_NS, and after the maximum break time in any case.
+ *
+ * @param rt the transition
+ * @param t timestamp of the sample
+ * @param sample the sample, or -1 in case of an ADC error
+ * @return true if the other relay may be closed now.
+ */
+bool relay_transition_update(struct relay_transition *rt, uint64_t t,
+			     int16_t sample)
+{
+     if (sample >= 0) {
+	  if (rt->has_window) {
+	       int16_t min = (sample < rt->window_min ? sample : rt->window_min);
+	       int16_t max = (sample > rt->window_max ? sample : rt->window_max);
+	       if (max-min > RELAY_SETTLE_COUNTS) {
+		    rt->has_window = false;
+	       } else {
+		    rt->window_min = min;
+		    rt->window_max = max;
+	       }
+	  }
+	  if (!rt->has_window) {
+	       rt->has_window = true;
+	       rt->t_window = t;
+	       rt->window_min = sample;
+	       rt->window_max = sample;
+	  }
+     }
+
+     uint64_t elapsed = t-rt->t_open;
+     // Break-before-make: never close the other relay before the opened
+     // relay has certainly released.
+     if (elapsed < RELAY_BREAK_MIN_NS)
+	  return false;
+     
+     return ((rt->has_window && t-rt->t_window >= RELAY_SETTLE_NS) ||
+	     elapsed >= RELAY_BREAK_MAX_NS);
+}
+
+/**
+ * Calculate the polling interval while charging from the predicted time
+ * to reach the upper threshold. Since the prediction is a lower bound, the
+ * threshold is not overshot by more than one sampling interval.
+ *
+ * @param sample current ADC count
+ * @param interval sampling interval (minimum polling interval)
+ * @return polling interval
+ */
+struct timespec charge_poll_interval(int16_t sample, struct timespec interval)
+{
+     double t = CHARGE_POLL_FRACTION*charge_time(sample, threshold_upper);
+     uint64_t poll_ns = CHARGE_POLL_MAX_NS;
+     if (t*1000000000.0 < poll_ns)
+	  poll_ns = (uint64_t) (t*1000000000.0);
+
+     if (poll_ns > to_nanosec(interval)) {
+	  interval.tv_sec = poll_ns/1000000000ull;
+	  interval.tv_nsec = poll_ns%1000000000ull;
+     }
+     
+     return interval;
+}
+
+/**
+ * Pass a sample to the logger thread.
+ *
+ * @param t timestamp
+ * @param epoch epoch
+ * @param value sample value
+ * @param type RING_ENTRY_SAMPLE, relay transition, or RING_ENTRY_SCHEDULE
+ * @param tick tick of the sampling schedule
+ * @return number of entries in the ring after adding the sample
+ */
+unsigned int put_sample(uint64_t t, uint64_t epoch, uint16_t value,
+			uint16_t type, uint32_t tick)
+{
+     struct ring_entry entry;
+     entry.timestamp = t;
+     entry.value = value;
+     entry.type = type;
+     entry.epoch = epoch;
+     entry.tick = tick;
+     unsigned int fill = ring_put(&the_ring, &entry);
+     stats_max(&the_stats, STATS_SAMPLER, STATS_RING_HIGH_WATER, fill);
+     if (fill == ring_size)
+	  stats_add(&the_stats, STATS_SAMPLER, STATS_RING_FULL, 1);
+
+     return fill;
+}
+
+/* State of the sampling loop. */
+enum State {charging, to_discharging, discharging, to_charging};
+
+/**
+ * Complete an iteration of the sampling loop for calibration and the flight
+ * recorder: add its timing to the calibration histograms (except for relay
+ * transitions, which are sampled at a different interval), complete its
+ * flight recorder entry, and freeze the trace if the sampling thread woke
+ * up late.
+ *
+ * @param fe the flight recorder entry, or NULL if the flight recorder is
+ * disabled
+ * @param tscheduled_ns scheduled sampling time
+ * @param twakeup_ns wakeup time
+ * @param state state of the sampling loop
+ * @param fill fill level of the ring after putting the sample (0 if none)
+ * @param interval_ns sampling interval of the iteration
+ */
+void iteration_done(struct flightrec_entry *fe, uint64_t tscheduled_ns,
+		    uint64_t twakeup_ns, uint16_t state, unsigned int fill,
+		    uint64_t interval_ns)
+{
+     if (is_rtcheck)
+	  rtcheck_iteration(&the_rtcheck, tscheduled_ns);
+     if (fe == NULL && !is_calibration)
+	  return;
+
+     uint64_t tend_ns = clocksrc_now(&the_clocksrc);
+     if (is_calibration && (state == charging || state == discharging)) {
+	  uint64_t latency = (twakeup_ns > tscheduled_ns ?
+			      twakeup_ns-tscheduled_ns : 0);
+	  histogram_add(&hist_latency, latency);
+	  histogram_add(&hist_cost, tend_ns-twakeup_ns);
+	  histogram_add(&hist_busy, latency+tend_ns-twakeup_ns);
+	  if (state == charging)
+	       calibration_charging++;
+	  else
+	       calibration_discharging++;
+     }
+     if (fe == NULL)
+	  return;
+     
+     fe->t_end = tend_ns;
+     fe->state = state;
+     fe->ring_fill = fill;
+     uint64_t threshold = (flightrec_lateness_ns > 0 ?
+			   flightrec_lateness_ns : interval_ns);
+     flightrec_commit(&the_flightrec,
+		      fe->t_wakeup > fe->t_scheduled+threshold);
 }
 
 /**
@@ -202,96 +820,197 @@ void *sampling_thread_loop(void *args)
 	  die(-1);
      }
 
+     if (sampler_cpu >= 0) {
+	  cpu_set_t cpus;
+	  CPU_ZERO(&cpus);
+	  CPU_SET(sampler_cpu, &cpus);
+	  if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+	       perror("sched_setaffinity failed");
+	       die(-1);
+	  }
+     }
+
+     if (is_rtcheck)
+	  rtcheck_start(&the_rtcheck, clocksrc_now(&the_clocksrc));
+
      /* Start infinite loop of charging-discharging cycles until user 
 	interrupts. */
 
-     /* Start in charge state */ 
-     struct timespec twait;
-     enum State {charging, discharging} state = charging;
-     // CAUTION: First open discharge relay before closing charge
-     // relay! Otherwise, a high current might flow into to
-     // discharged capacitor by-passing the limiting resistor.
-     bcm2835_gpio_clr(discharge_pin);
-     // Wait 100 ms to be sure that discharge relay is open
-     // (relay should open within less than 10 ms
-     // according to datasheet, so 100 ms should be safe).
-     twait.tv_sec = 0;
-     twait.tv_nsec = 100000000;
-     clock_nanosleep(CLOCK_MONOTONIC, 0, &twait, NULL);
-     bcm2835_gpio_set(charge_pin);
+     /* Start in charge state unless the capacitor is still charged from
+	a previous run. Both relays are open, so the probe sample is the
+	voltage of the capacitor. */ 
+     enum State state;
+     struct relay_transition rt;
+     int16_t probe = is_cold_start ? -1 : take_sample();
+     if (probe > threshold_lower) {
+	  set_relay(charge_pin, false);
+	  relay_transition_start(&rt);
+	  state = to_discharging;
+	  is_warm_start = true;
+     } else {
+	  // CAUTION: First open discharge relay before closing charge
+	  // relay! Otherwise, a high current might flow into to
+	  // discharged capacitor by-passing the limiting resistor.
+	  set_relay(discharge_pin, false);
+	  relay_transition_start(&rt);
+	  state = to_charging;
+     }
 
      uint64_t epoch = 0;
-     struct timespec tsample;
-     clock_gettime(CLOCK_MONOTONIC, &tsample);
+     struct rate_control rc;
+     rate_control_reset(&rc, 0);
+     struct timespec tsample = to_timespec(clocksrc_now(&the_clocksrc));
+     // Interval after which the next sample is late.
+     // Sampling interval of the sampling thread, changed by the stress
+     // test.
+     struct timespec sampler_interval = sampling_interval;
+     uint64_t interval_ns = to_nanosec(sampler_interval);
+     uint32_t cur_stress_level = 0;
      while (true) {
+	  struct flightrec_entry *fe = NULL;
+	  uint64_t twakeup_ns = 0;
+	  if (is_flightrec || is_calibration)
+	       twakeup_ns = clocksrc_now(&the_clocksrc);
+	  if (is_flightrec) {
+	       fe = flightrec_entry(&the_flightrec);
+	       fe->t_scheduled = to_nanosec(tsample);
+	       fe->t_wakeup = twakeup_ns;
+	  }
+	  unsigned int fill = 0;
+	  
+	  if (is_stress) {
+	       uint32_t level = __atomic_load_n(&stress_level,
+						__ATOMIC_RELAXED);
+	       if (level != cur_stress_level) {
+		    double f = sampling_frequency*(1u << level);
+		    sampler_interval = frequency_to_interval(f);
+		    schedule_init(&the_schedule, f);
+		    schedule_start(&the_schedule, to_nanosec(tsample));
+		    if (is_tick_log && state == discharging)
+			 put_sample(the_schedule.t0, epoch, 0,
+				    RING_ENTRY_SCHEDULE, the_schedule.num);
+		    cur_stress_level = level;
+	       }
+	  }
+	  
 	  // Take a sample 
-	  int16_t sample = get_sample_singleended(adc_channel);
+	  int16_t sample = take_sample();
 
 	  // Timestamp sample
-	  struct timespec tnow;
-	  clock_gettime(CLOCK_MONOTONIC , &tnow);
+	  uint64_t tnow_ns = clocksrc_now(&the_clocksrc);
+	  uint64_t tsample_ns = to_nanosec(tsample);
+	  if (fe != NULL) {
+	       fe->t_sample = tnow_ns;
+	       fe->value = sample;
+	  }
+	  stats_add(&the_stats, STATS_SAMPLER, STATS_SAMPLES_TAKEN, 1);
+	  if (tnow_ns > tsample_ns)
+	       stats_max(&the_stats, STATS_SAMPLER, STATS_WAKEUP_LATENCY_MAX,
+			 tnow_ns-tsample_ns);
+	  if (tnow_ns > tsample_ns+interval_ns)
+	       stats_add(&the_stats, STATS_SAMPLER, STATS_DEADLINE_MISSES, 1);
 	       
-	  if (sample == -1) {
-	       fprintf(stderr, "Error while taking sample\n");
-	  } else if (state == charging) {
+	  // Printing would delay the sampling thread; errors are reported by
+	  // the statistics.
+	  if (sample == -1)
+	       stats_add(&the_stats, STATS_SAMPLER, STATS_ADC_ERRORS, 1);
+
+	  if (state == charging && sample != -1) {
 	       // Stop charging when upper threshold was passed and then
 	       // switch to discharging phase.
 	       if (sample >= threshold_upper) {
 		    // Charged. Switch to discharging phase.
-		    state = discharging;
 		    // CAUTION: First open charge relay before closing discharge
 		    // relay! Otherwise, a high current might flow into to
 		    // capacitor by-passing the limiting resistor.
-		    bcm2835_gpio_clr(charge_pin);
-		    // Wait 100 ms to be sure that charge relay is open
-		    // (relay should open within less than 10 ms
-		    // according to datasheet, so 100 ms should be safe).
-		    twait.tv_sec = 0;
-		    twait.tv_nsec = 100000000;
-		    clock_nanosleep(CLOCK_MONOTONIC, 0, &twait, NULL);
-		    bcm2835_gpio_set(discharge_pin);
-		    // New sampling period starts now (right before taking
-		    // next sample).
-		    epoch++;
-		    clock_gettime(CLOCK_MONOTONIC, &tsample);
-	       } else {
-		    // Go on charging.
-		    // Sleep until next sampling time
-		    tsample = next_sampling_time(tsample, sampling_interval);
-		    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tsample, 
-				    NULL);
+		    set_relay(charge_pin, false);
+		    relay_transition_start(&rt);
+		    state = to_discharging;
 	       }
-	  } else if (state == discharging) {
+	  } else if (state == discharging && sample != -1) {
 	       // Record sample.
-	       struct ring_entry entry;
-	       entry.timestamp = to_nanosec(tnow);
-	       entry.value = sample;
-	       entry.epoch = epoch;
-	       ring_put(&the_ring, &entry);
+	       fill = put_sample(tnow_ns, epoch, sample, RING_ENTRY_SAMPLE,
+				 the_schedule.tick);
 
 	       // Switch to charging phase when lower threshold was passed.
 	       if (sample <= threshold_lower) {		    
 		    // Discharged. Switch to charging phase.
-		    state = charging;
 		    // CAUTION: First open discharge relay before closing 
 		    // charge relay! Otherwise, a high current might flow into 
 		    // to discharged capacitor by-passing the limiting resistor.
-		    bcm2835_gpio_clr(discharge_pin);
-		    // Wait 100 ms to be sure that discharge relay is open
-		    // (relay should open within less than 10 ms
-		    // according to datasheet, so 100 ms should be safe).
-		    twait.tv_sec = 0;
-		    twait.tv_nsec = 100000000;
-		    clock_nanosleep(CLOCK_MONOTONIC, 0, &twait, NULL);
-		    bcm2835_gpio_set(charge_pin);			 
-	       } else {
-		    // Go on discharging.
-		    // Sleep until next sampling time
-		    tsample = next_sampling_time(tsample, sampling_interval);
-		    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tsample, 
-				    NULL);
+		    set_relay(discharge_pin, false);
+		    relay_transition_start(&rt);
+		    state = to_charging;
+	       } else if (is_adaptive) {
+		    rate_control_update(&rc, sample);
+	       }
+	  } else if (state == to_charging || state == to_discharging) {
+	       // Relay transition: keep sampling while waiting until the
+	       // opened relay has released and the ADC trace has settled.
+	       // The transition is also updated after ADC errors, so the
+	       // other relay is closed after the maximum break time even if
+	       // the ADC keeps failing.
+	       bool is_to_discharging = (state == to_discharging);
+	       if (is_transition_log && sample != -1)
+		    fill = put_sample(tnow_ns,
+				      is_to_discharging ? epoch+1 : epoch,
+				      sample, is_to_discharging ?
+				      RING_ENTRY_TO_DISCHARGING :
+				      RING_ENTRY_TO_CHARGING, 0);
+	       if (relay_transition_update(&rt, tnow_ns, sample)) {
+		    stats_add(&the_stats, STATS_SAMPLER, STATS_RELAY_SWITCHES, 1);
+		    stats_max(&the_stats, STATS_SAMPLER, STATS_BREAK_TIME_MAX,
+			      tnow_ns-rt.t_open);
+		    if (is_to_discharging) {
+			 set_relay(discharge_pin, true);
+			 state = discharging;
+			 // New sampling period starts now (right before
+			 // taking next sample).
+			 epoch++;
+			 stats_add(&the_stats, STATS_SAMPLER, STATS_EPOCHS, 1);
+			 rate_control_reset(&rc, sample);
+		    } else {
+			 set_relay(charge_pin, true);
+			 state = charging;
+		    }
+		    iteration_done(fe, tsample_ns, twakeup_ns, state, fill,
+				   interval_ns);
+		    uint64_t tstart_ns = clocksrc_now(&the_clocksrc);
+		    tsample = to_timespec(tstart_ns);
+		    schedule_start(&the_schedule, tstart_ns);
+		    if (is_tick_log && state == discharging)
+			 put_sample(tstart_ns, epoch, 0, RING_ENTRY_SCHEDULE,
+				    the_schedule.num);
+		    interval_ns = to_nanosec(sampler_interval);
+		    continue;
 	       }
 	  }
+
+	  iteration_done(fe, tsample_ns, twakeup_ns, state, fill,
+			 interval_ns);
+	  
+	  // Sleep until next sampling time. While discharging, samples are
+	  // taken on the drift-free schedule started with the epoch.
+	  if (state == discharging) {
+	       uint64_t tlast_ns = the_schedule.t;
+	       uint64_t tnext_ns = schedule_advance(&the_schedule,
+						    1ull << rc.level);
+	       tsample = to_timespec(tnext_ns);
+	       interval_ns = tnext_ns-tlast_ns;
+	  } else {
+	       struct timespec interval = sampler_interval;
+	       if (state == to_charging || state == to_discharging) {
+		    if (to_nanosec(interval) > RELAY_SAMPLING_INTERVAL_NS) {
+			 interval.tv_sec = 0;
+			 interval.tv_nsec = RELAY_SAMPLING_INTERVAL_NS;
+		    }
+	       } else if (sample != -1 && !is_stress && !is_calibration) {
+		    interval = charge_poll_interval(sample, interval);
+	       }
+	       tsample = next_sampling_time(tsample, interval);
+	       interval_ns = to_nanosec(interval);
+	  }
+	  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tsample, NULL);
      }
 }
 
@@ -312,11 +1031,362 @@ void *logger_thread_loop(void *args)
 	  die(-1);
      }
      
+     /* Time of next power monitor report */
+     uint64_t tmonitor = 0;
+     bool is_first_sample = true;
+     while (true) {
+	  /* Taking all available entries at once saves locking the ring
+	     per entry when the logger has fallen behind. */
+	  struct ring_entry entries[LOGGER_BATCH];
+	  unsigned int n = ring_get_batch(&the_ring, entries, LOGGER_BATCH);
+	  /* Annotations queued while waiting for the batch precede its
+	     samples. */
+	  write_annotations();
+	  for (unsigned int i = 0; i < n; i++) {
+	       const struct ring_entry *entry = &entries[i];
+	       if (entry->type == RING_ENTRY_SCHEDULE) {
+		    csvlog_write_schedule(fout, &the_tick_log, entry->epoch,
+					  entry->timestamp, entry->tick);
+		    continue;
+	       } else if (entry->type != RING_ENTRY_SAMPLE) {
+		    log_transition(ftransitions, entry);
+		    continue;
+	       }
+	       if (is_first_sample) {
+		    fprintf(stderr, "Time to first sample: %.3f s (%s start)\n",
+			    (entry->timestamp-t_start_ns)/1000000000.0,
+			    is_warm_start ? "warm" : "cold");
+		    is_first_sample = false;
+	       }
+	       if (is_tick_log)
+		    log_tick(entry);
+	       else if (is_change_only)
+		    log_change(entry);
+	       else
+		    write_record(entry->timestamp, entry->epoch, entry->value,
+				 1);
+	       if (is_shmring_open)
+		    shmring_writer_put(&the_shmring, entry);
+	       if (is_streamsrv_open)
+		    streamsrv_publish(&the_streamsrv, entry);
+	       struct timespec tlogged;
+	       clock_gettime(CLOCK_MONOTONIC, &tlogged);
+	       uint64_t tlogged_ns = to_nanosec(tlogged);
+	       stats_add(&the_stats, STATS_LOGGER, STATS_SAMPLES_LOGGED, 1);
+	       // Timestamps from the hardware counter (-H) can be slightly
+	       // ahead of CLOCK_MONOTONIC.
+	       stats_max(&the_stats, STATS_LOGGER, STATS_LOG_LATENCY_MAX,
+			 (tlogged_ns > entry->timestamp ?
+			  tlogged_ns-entry->timestamp : 0));
+	       if (fmonitor != NULL) {
+		    powermon_add(&the_powermon, entry->timestamp, entry->epoch,
+				 entry->value);
+		    if (entry->timestamp >= tmonitor) {
+			 log_power(fmonitor, &the_powermon, entry->timestamp,
+				   entry->epoch);
+			 tmonitor = entry->timestamp+MONITOR_INTERVAL_NS;
+		    }
+	       }
+	       struct burst_event event;
+	       if (fevents != NULL &&
+		   burst_add(&the_burst_detector, entry->timestamp,
+			     entry->epoch, entry->value, &event))
+		    log_burst(fevents, &event);
+	  }
+     }
+}
+
+/**
+ * Write the statistics file. The file is replaced atomically, so readers
+ * never see a partially written file.
+ */
+void write_stats_file(const struct stats_snapshot *cur,
+		      const struct stats_snapshot *prev)
+{
+     FILE *f = fopen(statsfile_tmp, "w");
+     if (f == NULL) {
+	  perror("Could not write statistics file");
+	  return;
+     }
+     stats_print(f, &the_stats, cur, prev, false);
+     if (fclose(f) == EOF || rename(statsfile_tmp, statsfile) == -1)
+	  perror("Could not write statistics file");
+}
+
+/**
+ * Main loop of statistics thread. Reports the statistics periodically and
+ * dumps them to stderr on SIGUSR1. The thread runs with normal priority, so
+ * reporting never delays the sampling and logger threads.
+ */
+void *stats_thread_loop(void *args)
+{
+     sigset_t sigusr1;
+     sigemptyset(&sigusr1);
+     sigaddset(&sigusr1, SIGUSR1);
+
+     struct stats_snapshot prev, cur;
+     stats_snapshot(&the_stats, &prev);
+     while (true) {
+	  int sig = sigtimedwait(&sigusr1, NULL, &stats_interval);
+	  stats_snapshot(&the_stats, &cur);
+	  if (sig == SIGUSR1) {
+	       stats_print(stderr, &the_stats, &cur, NULL, false);
+	       continue;
+	  } else if (sig == -1 && errno != EAGAIN) {
+	       continue;
+	  }
+
+	  if (is_stats_line) {
+	       fprintf(stderr, "stats: ");
+	       stats_print(stderr, &the_stats, &cur, &prev, true);
+	  }
+	  if (statsfile != NULL)
+	       write_stats_file(&cur, &prev);
+	  prev = cur;
+     }
+
+     return NULL;
+}
+
+/**
+ * Main loop of the flight recorder thread: dumps frozen traces of the
+ * sampling loop. The thread runs with normal priority and polls, so
+ * freezing a trace costs the sampling thread no system call.
+ */
+void *flightrec_thread_loop(void *args)
+{
+     struct timespec poll_interval;
+     poll_interval.tv_sec = 0;
+     poll_interval.tv_nsec = FLIGHTREC_POLL_NS;
+     uint32_t dropped = 0;
+     while (true) {
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &poll_interval, NULL);
+	  flightrec_dump(&the_flightrec, fflight);
+	  uint32_t d = __atomic_load_n(&the_flightrec.dropped,
+				       __ATOMIC_RELAXED);
+	  if (d != dropped) {
+	       fprintf(stderr, "Flight recorder: %u late iterations while "
+		       "dumping\n", d-dropped);
+	       dropped = d;
+	  }
+     }
+
+     return NULL;
+}
+
+/**
+ * Main loop of the thread reporting real-time safety violations of the
+ * sampling thread to stderr.
+ */
+void *rtcheck_thread_loop(void *args)
+{
+     struct timespec poll_interval;
+     poll_interval.tv_sec = 0;
+     poll_interval.tv_nsec = RTCHECK_POLL_NS;
+     uint32_t dropped = 0;
+     while (true) {
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &poll_interval, NULL);
+	  struct rtcheck_report report;
+	  while (rtcheck_get(&the_rtcheck, &report))
+	       rtcheck_print(stderr, &report);
+	  uint32_t d = __atomic_load_n(&the_rtcheck.dropped,
+				       __ATOMIC_RELAXED);
+	  if (d != dropped) {
+	       fprintf(stderr, "RT check: %u violations not reported\n",
+		       d-dropped);
+	       dropped = d;
+	  }
+     }
+
+     return NULL;
+}
+
+/**
+ * Main loop of the thread re-calibrating the hardware counter timestamps of
+ * the sampling thread against CLOCK_MONOTONIC.
+ */
+void *clocksrc_thread_loop(void *args)
+{
+     uint64_t interval_ns = the_clocksrc.interval_ns;
+     while (true) {
+	  struct timespec interval = to_timespec(interval_ns);
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+	  interval_ns = clocksrc_calibrate(&the_clocksrc);
+     }
+
+     return NULL;
+}
+
+/**
+ * Main loop of the CPU monitor thread: polls CPU frequencies, throttling
+ * state, and temperature, and queues annotations of changes for the logger
+ * thread. The thread runs with normal priority on other CPUs than the
+ * sampling thread.
+ */
+void *cpumon_thread_loop(void *args)
+{
      while (true) {
-	  struct ring_entry entry;
-	  ring_get(&the_ring, &entry);
-	  log_sample(fout, entry.value, entry.timestamp, entry.epoch);
+	  struct timespec t;
+	  clock_gettime(CLOCK_MONOTONIC, &t);
+	  pthread_mutex_lock(&annotation_mutex);
+	  size_t len = cpumon_poll(&the_cpumon, to_nanosec(t),
+				   annotations+annotation_len,
+				   ANNOTATION_BUFFER_SIZE-annotation_len);
+	  __atomic_store_n(&annotation_len, annotation_len+len,
+			   __ATOMIC_RELAXED);
+	  pthread_mutex_unlock(&annotation_mutex);
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &cpumon_interval, NULL);
      }
+
+     return NULL;
+}
+
+/**
+ * Print the quantiles of a distribution of durations to stderr.
+ *
+ * @param name name of the distribution
+ * @param h the distribution
+ */
+void print_quantiles(const char *name, const struct histogram *h)
+{
+     fprintf(stderr, "%s [us]: median %.1f, 99%% %.1f, 99.9%% %.1f, "
+	     "99.99%% %.1f, max %.1f\n", name,
+	     histogram_quantile(h, 0.5)/1000.0,
+	     histogram_quantile(h, 0.99)/1000.0,
+	     histogram_quantile(h, 0.999)/1000.0,
+	     histogram_quantile(h, 0.9999)/1000.0,
+	     histogram_quantile(h, 1.0)/1000.0);
+}
+
+/**
+ * Run the calibration: the sampling thread runs as configured for the
+ * calibration duration. Then, the distributions of wakeup latency, loop
+ * cost, and busy time are printed as CSV to stdout (one line per bucket in
+ * microseconds), followed by quantiles and the maximum sampling frequency
+ * at which the rate of iterations exceeding the sampling interval is at
+ * most the target miss rate on stderr.
+ */
+void calibrate(void)
+{
+     clock_nanosleep(CLOCK_MONOTONIC, 0, &calibration_duration, NULL);
+     
+     // Stop sampling, so the histograms do not change anymore.
+     pthread_cancel(sampling_thread);
+     pthread_join(sampling_thread, NULL);
+
+     printf("lower_us,upper_us,wakeup_latency,loop_cost,busy\n");
+     for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+	  if (hist_latency.counts[i] == 0 && hist_cost.counts[i] == 0 &&
+	      hist_busy.counts[i] == 0)
+	       continue;
+	  printf("%.3f,%.3f,%llu,%llu,%llu\n",
+		 histogram_bucket_lower(i)/1000.0,
+		 (histogram_bucket_upper(i)+1)/1000.0,
+		 (unsigned long long) hist_latency.counts[i],
+		 (unsigned long long) hist_cost.counts[i],
+		 (unsigned long long) hist_busy.counts[i]);
+     }
+     fflush(stdout);
+
+     uint64_t n = histogram_count(&hist_busy);
+     fprintf(stderr, "Iterations: %llu (charging: %llu, discharging: %llu; "
+	     "relay transitions excluded)\n", (unsigned long long) n,
+	     (unsigned long long) calibration_charging,
+	     (unsigned long long) calibration_discharging);
+     if (n == 0)
+	  return;
+     print_quantiles("Wakeup latency", &hist_latency);
+     print_quantiles("Loop cost", &hist_cost);
+     print_quantiles("Busy time", &hist_busy);
+     
+     // Every iteration has to be completed within one sampling interval.
+     uint64_t busy = histogram_quantile(&hist_busy,
+					1.0-calibration_miss_rate);
+     if (busy == 0)
+	  busy = 1;
+     fprintf(stderr, "Maximum sampling frequency for a miss rate of at most "
+	     "%g: %.0f Hz\n", calibration_miss_rate, 1000000000.0/busy);
+     if (n*calibration_miss_rate < 1.0)
+	  fprintf(stderr, "Too few iterations for this miss rate; the "
+		  "frequency is based on the maximum busy time\n");
+}
+
+/**
+ * Highest sampling rate of the stress test, i.e., the rate of its last
+ * round.
+ *
+ * @return sampling rate in Hertz
+ */
+double stress_max_frequency(void)
+{
+     double rate = sampling_frequency;
+     for (int i = 1; i < STRESS_MAX_ROUNDS &&
+	       2.0*rate <= SCHEDULE_MAX_FREQUENCY; i++)
+	  rate *= 2.0;
+
+     return rate;
+}
+
+/**
+ * Run the stress test: starting with the sampling frequency given on the
+ * command line, the sampling rate is doubled every round until the sampling
+ * thread misses a deadline or the ring runs full. Prints one CSV line per
+ * round and the highest rate sustained without misses.
+ */
+void stress_test(void)
+{
+     double rate = sampling_frequency;
+     double sustained = 0.0;
+
+     /* Warm-up: the initial charging of the empty capacitor is not
+	representative. Stops if the sampling thread was cancelled by
+	SIGINT. */
+     struct timespec poll_interval;
+     poll_interval.tv_sec = 0;
+     poll_interval.tv_nsec = 10000000;
+     struct stats_snapshot snap;
+     do {
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &poll_interval, NULL);
+	  stats_snapshot(&the_stats, &snap);
+     } while (snap.counters[STATS_EPOCHS] == 0 && !is_interrupted);
+     if (is_interrupted)
+	  return;
+     
+     printf("rate,achieved_rate,samples_taken,samples_logged,"
+	    "deadline_misses,ring_full,result\n");
+     for (int i = 0; i < STRESS_MAX_ROUNDS &&
+	       rate <= SCHEDULE_MAX_FREQUENCY && !is_interrupted;
+	  i++, rate *= 2.0) {
+	  __atomic_store_n(&stress_level, i, __ATOMIC_RELAXED);
+	  struct stats_snapshot before, after;
+	  stats_snapshot(&the_stats, &before);
+	  clock_nanosleep(CLOCK_MONOTONIC, 0, &stress_round, NULL);
+	  stats_snapshot(&the_stats, &after);
+
+	  uint64_t delta[STATS_COUNT];
+	  for (int c = 0; c < STATS_COUNT; c++)
+	       delta[c] = after.counters[c]-before.counters[c];
+	  bool pass = (delta[STATS_SAMPLES_TAKEN] > 0 &&
+		       delta[STATS_DEADLINE_MISSES] == 0 &&
+		       delta[STATS_RING_FULL] == 0);
+	  printf("%g,%.1f,%llu,%llu,%llu,%llu,%s\n", rate,
+		 delta[STATS_SAMPLES_TAKEN]/((after.t-before.t)/1000000000.0),
+		 (unsigned long long) delta[STATS_SAMPLES_TAKEN],
+		 (unsigned long long) delta[STATS_SAMPLES_LOGGED],
+		 (unsigned long long) delta[STATS_DEADLINE_MISSES],
+		 (unsigned long long) delta[STATS_RING_FULL],
+		 pass ? "pass" : "fail");
+	  fflush(stdout);
+	  if (!pass)
+	       break;
+	  sustained = rate;
+     }
+
+     if (sustained > 0.0)
+	  fprintf(stderr, "Sustained sampling rate: %g Hz\n", sustained);
+     else
+	  fprintf(stderr, "Sampling rate of %g Hz not sustained\n",
+		  sampling_frequency);
 }
 
 /* Configure GPIO pins controlling charge and discharge relays */
@@ -329,11 +1399,44 @@ void setup_gpio()
      bcm2835_gpio_clr(discharge_pin);
 }
 
+/* Setup SPI interface of the ADC and GPIO pins of the relays */
+void setup_hardware()
+{
+     if (bcm2835_init() == 0) {
+	  die(-1);
+     } else {
+	  is_bcm_open = true;
+     }
+     
+     bcm2835_spi_begin();
+     is_spi_open = true;
+     
+     bcm2835_spi_chipSelect(spi_cs);
+
+     // Set divider according to SPI frequency
+     uint16_t divider = (uint16_t) ((double) 250000000/spi_frequency + 0.5);
+     bcm2835_spi_setClockDivider(divider);
+
+     // SPI 0,0 as per MCP3208 data sheet
+     bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+
+     bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+
+     bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+
+     // Configure GPIO pins as output and set output to low.
+     setup_gpio();
+}
+
 /**
  * The main function.
  */
 int main(int argc, char *argv[])
 {
+     struct timespec tstart;
+     clock_gettime(CLOCK_MONOTONIC, &tstart);
+     t_start_ns = to_nanosec(tstart);
+     
      /* Parse command line arguments */
      
      char *sampling_frequency_arg = NULL;
@@ -341,8 +1444,37 @@ int main(int argc, char *argv[])
      char *threshold_upper_arg = NULL;
      char *threshold_lower_arg = NULL;
      char *task_priority_arg = NULL;
+     char *indexfile_arg = NULL;
+     char *monitorfile_arg = NULL;
+     char *eventfile_arg = NULL;
+     char *min_frequency_arg = NULL;
+     char *keepalive_arg = NULL;
+     char *shmname_arg = NULL;
+     char *socketpath_arg = NULL;
+     char *stats_interval_arg = NULL;
+     char *ring_size_arg = NULL;
+     char *stress_arg = NULL;
+     char *transitionfile_arg = NULL;
+     char *tick_tolerance_arg = NULL;
+     char *flightfile_arg = NULL;
+     char *lateness_arg = NULL;
+     char *calibration_arg = NULL;
+     char *miss_rate_arg = NULL;
+     char *cpu_arg = NULL;
+     char *cpumon_interval_arg = NULL;
+     char *rtcheck_arg = NULL;
+     bool is_governor_lock = false;
+     static const struct option long_options[] = {
+	  {"calibrate", optional_argument, NULL, OPT_CALIBRATE},
+	  {"miss-rate", required_argument, NULL, OPT_MISS_RATE},
+	  {"simulate", no_argument, NULL, OPT_SIMULATE},
+	  {"rt-check", optional_argument, NULL, OPT_RT_CHECK},
+	  {NULL, 0, NULL, 0}
+     };
      int c;
-     while ((c = getopt(argc, argv, "f:o:p:l:u:")) != -1) {
+     while ((c = getopt_long(argc, argv,
+			     "f:o:p:l:u:i:m:e:a:c:s:U:S:T:R:x:t:CHk:J:j:A:F:G",
+			     long_options, NULL)) != -1) {
 	  switch (c) {
 	  case 'f' :
 	       sampling_frequency_arg = malloc(strlen(optarg)+1);
@@ -364,6 +1496,104 @@ int main(int argc, char *argv[])
 	       task_priority_arg = malloc(strlen(optarg)+1);
 	       strcpy(task_priority_arg, optarg);
 	       break;
+	  case 'i' :
+	       indexfile_arg = malloc(strlen(optarg)+1);
+	       strcpy(indexfile_arg, optarg);
+	       break;
+	  case 'm' :
+	       monitorfile_arg = malloc(strlen(optarg)+1);
+	       strcpy(monitorfile_arg, optarg);
+	       break;
+	  case 'e' :
+	       eventfile_arg = malloc(strlen(optarg)+1);
+	       strcpy(eventfile_arg, optarg);
+	       break;
+	  case 'a' :
+	       min_frequency_arg = malloc(strlen(optarg)+1);
+	       strcpy(min_frequency_arg, optarg);
+	       break;
+	  case 'c' :
+	       keepalive_arg = malloc(strlen(optarg)+1);
+	       strcpy(keepalive_arg, optarg);
+	       break;
+	  case 's' :
+	       shmname_arg = malloc(strlen(optarg)+1);
+	       strcpy(shmname_arg, optarg);
+	       break;
+	  case 'U' :
+	       socketpath_arg = malloc(strlen(optarg)+1);
+	       strcpy(socketpath_arg, optarg);
+	       break;
+	  case 'S' :
+	       stats_interval_arg = malloc(strlen(optarg)+1);
+	       strcpy(stats_interval_arg, optarg);
+	       break;
+	  case 'T' :
+	       statsfile = malloc(strlen(optarg)+1);
+	       strcpy(statsfile, optarg);
+	       break;
+	  case 'R' :
+	       ring_size_arg = malloc(strlen(optarg)+1);
+	       strcpy(ring_size_arg, optarg);
+	       break;
+	  case 'x' :
+	       stress_arg = malloc(strlen(optarg)+1);
+	       strcpy(stress_arg, optarg);
+	       break;
+	  case 't' :
+	       transitionfile_arg = malloc(strlen(optarg)+1);
+	       strcpy(transitionfile_arg, optarg);
+	       break;
+	  case 'C' :
+	       is_cold_start = true;
+	       break;
+	  case 'H' :
+	       is_counter_clock = true;
+	       break;
+	  case 'k' :
+	       tick_tolerance_arg = malloc(strlen(optarg)+1);
+	       strcpy(tick_tolerance_arg, optarg);
+	       break;
+	  case 'J' :
+	       flightfile_arg = malloc(strlen(optarg)+1);
+	       strcpy(flightfile_arg, optarg);
+	       break;
+	  case 'j' :
+	       lateness_arg = malloc(strlen(optarg)+1);
+	       strcpy(lateness_arg, optarg);
+	       break;
+	  case 'A' :
+	       cpu_arg = malloc(strlen(optarg)+1);
+	       strcpy(cpu_arg, optarg);
+	       break;
+	  case 'F' :
+	       cpumon_interval_arg = malloc(strlen(optarg)+1);
+	       strcpy(cpumon_interval_arg, optarg);
+	       break;
+	  case 'G' :
+	       is_governor_lock = true;
+	       break;
+	  case OPT_CALIBRATE :
+	       is_calibration = true;
+	       if (optarg != NULL) {
+		    calibration_arg = malloc(strlen(optarg)+1);
+		    strcpy(calibration_arg, optarg);
+	       }
+	       break;
+	  case OPT_MISS_RATE :
+	       miss_rate_arg = malloc(strlen(optarg)+1);
+	       strcpy(miss_rate_arg, optarg);
+	       break;
+	  case OPT_SIMULATE :
+	       is_simulated = true;
+	       break;
+	  case OPT_RT_CHECK :
+	       is_rtcheck = true;
+	       if (optarg != NULL) {
+		    rtcheck_arg = malloc(strlen(optarg)+1);
+		    strcpy(rtcheck_arg, optarg);
+	       }
+	       break;
 	  case '?':
 	       fprintf(stderr, "Unknown option\n");
 	       usage(argv[0]);
@@ -372,6 +1602,12 @@ int main(int argc, char *argv[])
 	  }
      }
 	      
+     /* The calibration does not need a log file. */
+     if (is_calibration && logfile_arg == NULL) {
+	  logfile_arg = malloc(strlen("/dev/null")+1);
+	  strcpy(logfile_arg, "/dev/null");
+     }
+     
      if (sampling_frequency_arg == NULL || logfile_arg == NULL ||
 	 threshold_lower_arg == NULL || threshold_upper_arg == NULL) {
 	  usage(argv[0]);
@@ -382,39 +1618,193 @@ int main(int argc, char *argv[])
      threshold_upper = atoi(threshold_upper_arg);
      sampling_frequency = strtod(sampling_frequency_arg, NULL);
      sampling_interval = frequency_to_interval(sampling_frequency);
+     if (schedule_init(&the_schedule, sampling_frequency) == -1) {
+	  fprintf(stderr, "Sampling frequency must be in range (0, %g] Hz\n",
+		  SCHEDULE_MAX_FREQUENCY);
+	  die(-1);
+     }
 
-     if (task_priority_arg != NULL) {
-	  task_priority = atoi(task_priority_arg);
-     } else {
-	  task_priority = DEFAULT_TASK_PRIORITY;
+     if (min_frequency_arg != NULL) {
+	  // Rates between the maximum frequency (-f) and the minimum
+	  // frequency in steps of factor 2.
+	  double min_frequency = strtod(min_frequency_arg, NULL);
+	  if (min_frequency <= 0.0 || min_frequency > sampling_frequency) {
+	       fprintf(stderr, "Minimum sampling frequency must be in range "
+		       "(0, SAMPLING_FREQUENCY]\n");
+	       die(-1);
+	  }
+	  is_adaptive = true;
+	  double f = sampling_frequency;
+	  rate_levels = 0;
+	  while (rate_levels < MAX_RATE_LEVELS && f >= min_frequency) {
+	       rate_levels++;
+	       f /= 2.0;
+	  }
      }
-     
-     /* Setup SPI */
 
-     if (bcm2835_init() == 0) {
-	  die(-1);
-     } else {
-	  is_bcm_open = true;
+     if (keepalive_arg != NULL) {
+	  is_change_only = true;
+	  keepalive_ns = (uint64_t) (strtod(keepalive_arg, NULL)*1000000000.0 +
+				     0.5);
+	  the_run.pending = false;
+     }
+
+     if (tick_tolerance_arg != NULL) {
+	  if (is_change_only || indexfile_arg != NULL) {
+	       fprintf(stderr, "Tick log cannot be combined with change-only "
+		       "logging or an index file\n");
+	       die(-1);
+	  }
+	  is_tick_log = true;
+	  tick_tolerance_ns = (uint64_t) (strtod(tick_tolerance_arg, NULL)*
+					  1000.0 + 0.5);
+	  csvlog_tick_init(&the_tick_log);
      }
      
-     bcm2835_spi_begin();
-     is_spi_open = true;
-     
-     bcm2835_spi_chipSelect(spi_cs);
+     stats_interval.tv_sec = 1;
+     stats_interval.tv_nsec = 0;
+     if (stats_interval_arg != NULL) {
+	  double seconds = strtod(stats_interval_arg, NULL);
+	  if (seconds <= 0.0) {
+	       fprintf(stderr, "Statistics interval must be positive\n");
+	       die(-1);
+	  }
+	  stats_interval = frequency_to_interval(1.0/seconds);
+	  is_stats_line = true;
+     }
+     if (statsfile != NULL) {
+	  statsfile_tmp = malloc(strlen(statsfile)+5);
+	  strcpy(statsfile_tmp, statsfile);
+	  strcat(statsfile_tmp, ".tmp");
+     }
+     stats_init(&the_stats);
 
-     // Set divider according to SPI frequency
-     uint16_t divider = (uint16_t) ((double) 250000000/spi_frequency + 0.5);
-     bcm2835_spi_setClockDivider(divider);
+     if (ring_size_arg != NULL) {
+	  ring_size = strtoul(ring_size_arg, NULL, 10);
+	  if (ring_size == 0 || (ring_size & (ring_size-1)) != 0) {
+	       fprintf(stderr, "Ring size must be a power of 2\n");
+	       die(-1);
+	  }
+     }
 
-     // SPI 0,0 as per MCP3208 data sheet
-     bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+     if (stress_arg != NULL) {
+	  double seconds = strtod(stress_arg, NULL);
+	  if (seconds <= 0.0) {
+	       fprintf(stderr, "Stress test round must be positive\n");
+	       die(-1);
+	  }
+	  is_stress = true;
+	  is_simulated = true;
+	  stress_round = frequency_to_interval(1.0/seconds);
+	  stress_level = 0;
+     }
 
-     bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+     if (is_calibration) {
+	  if (is_stress) {
+	       fprintf(stderr, "Calibration and stress test cannot be "
+		       "combined\n");
+	       die(-1);
+	  }
+	  double seconds = CALIBRATION_SECONDS;
+	  if (calibration_arg != NULL)
+	       seconds = strtod(calibration_arg, NULL);
+	  if (seconds <= 0.0) {
+	       fprintf(stderr, "Calibration duration must be positive\n");
+	       die(-1);
+	  }
+	  calibration_duration = frequency_to_interval(1.0/seconds);
+	  if (miss_rate_arg != NULL)
+	       calibration_miss_rate = strtod(miss_rate_arg, NULL);
+	  if (calibration_miss_rate < 0.0 || calibration_miss_rate >= 1.0) {
+	       fprintf(stderr, "Miss rate must be in range [0, 1)\n");
+	       die(-1);
+	  }
+	  histogram_init(&hist_latency);
+	  histogram_init(&hist_cost);
+	  histogram_init(&hist_busy);
+     }
 
-     bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+     if (cpu_arg != NULL) {
+	  sampler_cpu = atoi(cpu_arg);
+	  if (sampler_cpu < 0 || sampler_cpu >= CPU_SETSIZE) {
+	       fprintf(stderr, "Invalid CPU of sampling thread\n");
+	       die(-1);
+	  }
+     }
 
-     // Configure GPIO pins as output and set output to low.
-     setup_gpio();
+     if (is_rtcheck) {
+	  double seconds = (rtcheck_arg != NULL ?
+			    strtod(rtcheck_arg, NULL) : RTCHECK_SECONDS);
+	  if (seconds <= 0.0) {
+	       fprintf(stderr, "RT check interval must be positive\n");
+	       die(-1);
+	  }
+	  rtcheck_init(&the_rtcheck, (uint64_t) (seconds*1000000000.0));
+	  if (!rtcheck_counts_allocs)
+	       fprintf(stderr, "RT check: allocator calls are not counted "
+		       "(use low-energy-meter-rtcheck)\n");
+     }
+
+     /* The CPU monitor runs on all CPUs except the CPU of the sampling
+	thread. */
+     cpu_set_t cpumon_cpus;
+     if (cpumon_interval_arg != NULL) {
+	  double seconds = strtod(cpumon_interval_arg, NULL);
+	  if (seconds <= 0.0) {
+	       fprintf(stderr, "CPU monitor interval must be positive\n");
+	       die(-1);
+	  }
+	  cpumon_interval = frequency_to_interval(1.0/seconds);
+	  if (sampler_cpu < 0) {
+	       fprintf(stderr, "CPU monitor requires a pinned sampling "
+		       "thread (-A)\n");
+	       die(-1);
+	  }
+	  if (sched_getaffinity(0, sizeof(cpumon_cpus), &cpumon_cpus) == -1) {
+	       perror("sched_getaffinity failed");
+	       die(-1);
+	  }
+	  CPU_CLR(sampler_cpu, &cpumon_cpus);
+	  if (CPU_COUNT(&cpumon_cpus) == 0) {
+	       fprintf(stderr, "No CPU for the CPU monitor besides the CPU of "
+		       "the sampling thread\n");
+	       die(-1);
+	  }
+	  cpumon_init(&the_cpumon);
+	  is_cpumon = true;
+     }
+
+     if (is_governor_lock) {
+	  cpumon_init(&the_cpumon);
+	  if (cpumon_lock_governor(&the_cpumon) == -1) {
+	       perror("Could not set CPU governor");
+	       die(-1);
+	  }
+	  fprintf(stderr, "CPU governor: performance\n");
+	  annotation_len = snprintf(annotations, ANNOTATION_BUFFER_SIZE,
+				    "#%llu,governor,performance\n",
+				    (unsigned long long) t_start_ns);
+     }
+
+     /* SIGUSR1 is handled by the statistics thread only. Block it before
+	any thread is created, so all threads inherit the signal mask. */
+     sigset_t sigusr1;
+     sigemptyset(&sigusr1);
+     sigaddset(&sigusr1, SIGUSR1);
+     pthread_sigmask(SIG_BLOCK, &sigusr1, NULL);
+     
+     if (task_priority_arg != NULL) {
+	  task_priority = atoi(task_priority_arg);
+     } else {
+	  task_priority = DEFAULT_TASK_PRIORITY;
+     }
+     
+     /* Setup SPI and GPIO, or synthetic ADC */
+
+     if (is_simulated)
+	  simadc_init(&the_simadc);
+     else
+	  setup_hardware();
      
      /* Open log file */
 
@@ -423,10 +1813,114 @@ int main(int argc, char *argv[])
 	  perror("Could not open log file");
 	  die(-1);
      }
+     if (is_tick_log)
+	  fprintf(fout, "%s\n", CSVLOG_TICK_MAGIC);
+
+     /* Open index file */
+
+     if (indexfile_arg != NULL) {
+	  if (logindex_writer_open(&the_index, indexfile_arg,
+				   LOGINDEX_BUCKET_NS) == -1) {
+	       perror("Could not open index file");
+	       die(-1);
+	  }
+	  is_index_open = true;
+     }
+
+     /* Create shared-memory ring for live readers */
+
+     if (shmname_arg != NULL) {
+	  if (shmring_writer_open(&the_shmring, shmname_arg) == -1) {
+	       perror("Could not create shared-memory ring");
+	       die(-1);
+	  }
+	  is_shmring_open = true;
+     }
+
+     /* Start streaming server */
+
+     if (socketpath_arg != NULL) {
+	  if (streamsrv_open(&the_streamsrv, socketpath_arg) == -1) {
+	       perror("Could not start streaming server");
+	       die(-1);
+	  }
+	  is_streamsrv_open = true;
+     }
+
+     /* Open power monitor file */
+
+     if (monitorfile_arg != NULL) {
+	  /* The windows are sized once for the highest sampling rate, so
+	     the logger thread never allocates memory. */
+	  double max_frequency = (is_stress ? stress_max_frequency() :
+				  sampling_frequency);
+	  if (powermon_init(&the_powermon, max_frequency) == -1) {
+	       perror("Could not allocate power monitor");
+	       die(-1);
+	  }
+	  fmonitor = fopen(monitorfile_arg, "w");
+	  if (fmonitor == NULL) {
+	       perror("Could not open monitor file");
+	       die(-1);
+	  }
+	  /* Make every report visible immediately, e.g., to tail -f. */
+	  setvbuf(fmonitor, NULL, _IOLBF, 0);
+     }
+
+     /* Open event file for activity bursts */
+
+     if (eventfile_arg != NULL) {
+	  burst_init(&the_burst_detector);
+	  fevents = fopen(eventfile_arg, "w");
+	  if (fevents == NULL) {
+	       perror("Could not open event file");
+	       die(-1);
+	  }
+     }
+
+     /* Open transition log */
+
+     if (transitionfile_arg != NULL) {
+	  ftransitions = fopen(transitionfile_arg, "w");
+	  if (ftransitions == NULL) {
+	       perror("Could not open transition file");
+	       die(-1);
+	  }
+	  is_transition_log = true;
+     }
+
+     /* Open flight recorder file */
+
+     if (flightfile_arg != NULL) {
+	  fflight = fopen(flightfile_arg, "w");
+	  if (fflight == NULL) {
+	       perror("Could not open flight recorder file");
+	       die(-1);
+	  }
+	  flightrec_write_header(fflight);
+	  flightrec_init(&the_flightrec);
+	  if (lateness_arg != NULL)
+	       flightrec_lateness_ns = (uint64_t) (strtod(lateness_arg, NULL)*
+						   1000.0 + 0.5);
+	  is_flightrec = true;
+     }
 
      // Init ring buffer for communicate between sampling and logging threads.
 
-     ring_init(&the_ring);
+     if (ring_init(&the_ring, ring_size) == -1) {
+	  perror("Could not initialize ring");
+	  die(-1);
+     }
+
+     /* Calibrate timestamp source of the sampling thread */
+
+     if (clocksrc_init(&the_clocksrc, is_counter_clock) == -1) {
+	  perror("Hardware counter not usable as clock source");
+	  die(-1);
+     }
+     if (is_counter_clock)
+	  fprintf(stderr, "Hardware counter frequency: %.0f Hz\n",
+		  clocksrc_frequency(&the_clocksrc));
 
      /* Lock memory and prefault stack */
 
@@ -449,6 +1943,42 @@ int main(int argc, char *argv[])
 	  die(-1);
      }
 
+     if (pthread_create(&stats_thread, NULL, stats_thread_loop, NULL)) {
+	  perror("Could not create statistics thread");
+	  die(-1);
+     }
+
+     if (is_counter_clock &&
+	 pthread_create(&clocksrc_thread, NULL, clocksrc_thread_loop, NULL)) {
+	  perror("Could not create clock calibration thread");
+	  die(-1);
+     }
+
+     if (is_flightrec &&
+	 pthread_create(&flightrec_thread, NULL, flightrec_thread_loop, NULL)) {
+	  perror("Could not create flight recorder thread");
+	  die(-1);
+     }
+
+     if (is_rtcheck &&
+	 pthread_create(&rtcheck_thread, NULL, rtcheck_thread_loop, NULL)) {
+	  perror("Could not create RT check thread");
+	  die(-1);
+     }
+
+     if (is_cpumon) {
+	  pthread_attr_t attr;
+	  pthread_attr_init(&attr);
+	  pthread_attr_setaffinity_np(&attr, sizeof(cpumon_cpus), &cpumon_cpus);
+	  int status = pthread_create(&cpumon_thread, &attr,
+				      cpumon_thread_loop, NULL);
+	  pthread_attr_destroy(&attr);
+	  if (status) {
+	       perror("Could not create CPU monitor thread");
+	       die(-1);
+	  }
+     }
+
      /* Install SIGINT signal handler for graceful termination */
      
      if (signal(SIGINT, sig_int) == SIG_ERR) {
@@ -456,6 +1986,16 @@ int main(int argc, char *argv[])
 	  die(-1);
      }
      
+     if (is_stress) {
+	  stress_test();
+	  die(0);
+     }
+
+     if (is_calibration) {
+	  calibrate();
+	  die(0);
+     }
+     
      pthread_join(logger_thread, NULL);
      pthread_join(sampling_thread, NULL);
 
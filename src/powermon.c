@@ -0,0 +1,204 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "powermon.h"
+#include "energy.h"
+
+#include <stdlib.h>
+
+/**
+ * Remove all samples from a window.
+ */
+static void window_clear(struct powermon_window *w)
+{
+     w->next = 0;
+     w->first = 0;
+     w->anchor = 0;
+     w->anchor_t = 0;
+}
+
+/**
+ * Recalculate the prefix sums of all samples in the window relative to
+ * the oldest sample.
+ */
+static void window_rebase(struct powermon_window *w)
+{
+     w->anchor = w->first;
+     w->anchor_t = w->t[w->first%w->capacity];
+
+     double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+     for (uint64_t i = w->first; i < w->next; i++) {
+	  uint64_t pos = i%w->capacity;
+	  double x = (w->t[pos]-w->anchor_t)/1000000000.0;
+	  double y = w->y[pos];
+	  sx += x;
+	  sy += y;
+	  sxx += x*x;
+	  sxy += x*y;
+	  w->px[pos] = sx;
+	  w->py[pos] = sy;
+	  w->pxx[pos] = sxx;
+	  w->pxy[pos] = sxy;
+     }
+}
+
+/**
+ * Add a sample to a window.
+ */
+static void window_add(struct powermon_window *w, uint64_t t, double y)
+{
+     if (w->next == w->anchor)
+	  w->anchor_t = t;
+
+     uint64_t pos = w->next%w->capacity;
+     double x = (t-w->anchor_t)/1000000000.0;
+     double sx = x, sy = y, sxx = x*x, sxy = x*y;
+     if (w->next > w->anchor) {
+	  uint64_t prev = (w->next-1)%w->capacity;
+	  sx += w->px[prev];
+	  sy += w->py[prev];
+	  sxx += w->pxx[prev];
+	  sxy += w->pxy[prev];
+     }
+     w->t[pos] = t;
+     w->y[pos] = y;
+     w->px[pos] = sx;
+     w->py[pos] = sy;
+     w->pxx[pos] = sxx;
+     w->pxy[pos] = sxy;
+     w->next++;
+
+     /* Remove samples that left the window. At most half of the ring is
+	used by the window, so the prefix sum before the oldest sample is
+	still available. */
+     while (w->first < w->next &&
+	    (t-w->t[w->first%w->capacity] > w->width_ns ||
+	     w->next-w->first > w->capacity/2))
+	  w->first++;
+	  
+     /* Rebase before the sample where prefix sums start is overwritten.
+	Since the window covers at most half of the ring, this happens at
+	most every capacity/2 samples. */
+     if (w->next-w->anchor == w->capacity)
+	  window_rebase(w);
+}
+
+int powermon_init(struct powermon *pm, double sampling_frequency)
+{
+     const double widths[POWERMON_WINDOWS] = POWERMON_WIDTHS;
+
+     for (int i = 0; i < POWERMON_WINDOWS; i++) {
+	  struct powermon_window *w = &pm->windows[i];
+	  w->width_ns = (uint64_t) (widths[i]*1000000000.0);
+	  /* Twice the number of samples per window plus some headroom
+	     for sampling jitter. The ring is allocated once, since
+	     samples are added by the real-time logger thread. */
+	  w->capacity = 2*(uint64_t) (widths[i]*sampling_frequency) + 16;
+	  if (w->capacity > POWERMON_MAX_CAPACITY)
+	       w->capacity = POWERMON_MAX_CAPACITY;
+	  w->t = malloc(w->capacity*sizeof(uint64_t));
+	  w->y = malloc(w->capacity*sizeof(double));
+	  w->px = malloc(w->capacity*sizeof(double));
+	  w->py = malloc(w->capacity*sizeof(double));
+	  w->pxx = malloc(w->capacity*sizeof(double));
+	  w->pxy = malloc(w->capacity*sizeof(double));
+	  if (w->t == NULL || w->y == NULL || w->px == NULL ||
+	      w->py == NULL || w->pxx == NULL || w->pxy == NULL) {
+	       for (int j = i+1; j < POWERMON_WINDOWS; j++)
+		    pm->windows[j].capacity = 0;
+	       powermon_destroy(pm);
+	       return -1;
+	  }
+	  window_clear(w);
+     }
+
+     pm->epoch = 0;
+     
+     return 0;
+}
+
+void powermon_destroy(struct powermon *pm)
+{
+     for (int i = 0; i < POWERMON_WINDOWS; i++) {
+	  struct powermon_window *w = &pm->windows[i];
+	  if (w->capacity == 0)
+	       continue;
+	  free(w->t);
+	  free(w->y);
+	  free(w->px);
+	  free(w->py);
+	  free(w->pxx);
+	  free(w->pxy);
+	  w->capacity = 0;
+     }
+}
+
+void powermon_add(struct powermon *pm, uint64_t t, uint64_t epoch,
+		  uint16_t value)
+{
+     if (epoch != pm->epoch) {
+	  for (int i = 0; i < POWERMON_WINDOWS; i++)
+	       window_clear(&pm->windows[i]);
+	  pm->epoch = epoch;
+     }
+
+     double v = adc_to_voltage(value);
+     for (int i = 0; i < POWERMON_WINDOWS; i++)
+	  window_add(&pm->windows[i], t, v*v);
+}
+
+double powermon_power(const struct powermon *pm, int window)
+{
+     const struct powermon_window *w = &pm->windows[window];
+     
+     if (w->next-w->first < 2)
+	  return 0.0;
+
+     uint64_t last = (w->next-1)%w->capacity;
+     double n = w->next-w->first;
+     double sx = w->px[last];
+     double sy = w->py[last];
+     double sxx = w->pxx[last];
+     double sxy = w->pxy[last];
+     if (w->first > w->anchor) {
+	  uint64_t before = (w->first-1)%w->capacity;
+	  sx -= w->px[before];
+	  sy -= w->py[before];
+	  sxx -= w->pxx[before];
+	  sxy -= w->pxy[before];
+     }
+
+     double denom = n*sxx-sx*sx;
+     if (denom <= 0.0)
+	  return 0.0;
+
+     /* P = -0.5*C*dV^2/dt */
+     return -0.5*CAPACITANCE*(n*sxy-sx*sy)/denom;
+}
+
+double powermon_span(const struct powermon *pm, int window)
+{
+     const struct powermon_window *w = &pm->windows[window];
+     
+     if (w->next-w->first < 2)
+	  return 0.0;
+
+     return (w->t[(w->next-1)%w->capacity]-w->t[w->first%w->capacity])/
+	  1000000000.0;
+}
@@ -0,0 +1,126 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef POWERMON_H
+#define POWERMON_H
+
+#include <stdint.h>
+
+/* Number of sliding windows and their widths in seconds */
+#define POWERMON_WINDOWS 3
+#define POWERMON_WIDTHS {1, 10, 60}
+
+/* Maximum capacity of the ring of a window (48 bytes per entry). A window
+   holds at most half of its capacity, i.e., 2^17 samples (60 s at
+   2.1 kHz). */
+#define POWERMON_MAX_CAPACITY (1ull << 18)
+
+/**
+ * Sliding time window over the samples of the current epoch.
+ *
+ * The window keeps prefix sums of x (time since anchor [s]), y (V^2), x^2,
+ * and x*y in a ring, so the least-squares fit of the samples in the window
+ * is calculated in O(1) from the difference of two prefix sums. To avoid
+ * loss of precision, the prefix sums are periodically recalculated
+ * relative to the oldest sample of the window (amortized O(1) per sample).
+ * The ring is sized for the maximum sampling frequency, up to
+ * POWERMON_MAX_CAPACITY; beyond, the number of samples rather than the
+ * width limits the window.
+ */
+struct powermon_window {
+     uint64_t width_ns;
+     
+     /* Ring of samples with index i stored at position i%capacity. */
+     uint64_t capacity;
+     uint64_t *t;
+     double *y;
+     double *px;
+     double *py;
+     double *pxx;
+     double *pxy;
+
+     /* Index of the next sample. */
+     uint64_t next;
+     /* Index of the oldest sample in the window. */
+     uint64_t first;
+     /* Index of the sample where prefix sums start, and its timestamp. */
+     uint64_t anchor;
+     uint64_t anchor_t;
+};
+
+/**
+ * Sliding-window power monitor.
+ */
+struct powermon {
+     struct powermon_window windows[POWERMON_WINDOWS];
+
+     uint64_t epoch;
+};
+
+/**
+ * Initialize a power monitor.
+ *
+ * @param pm the power monitor
+ * @param sampling_frequency maximum sampling frequency in Hertz, which
+ * determines the number of samples per window
+ * @return 0 on success, or -1 if memory could not be allocated.
+ */
+int powermon_init(struct powermon *pm, double sampling_frequency);
+
+/**
+ * Destroy a power monitor.
+ *
+ * @param pm the power monitor
+ */
+void powermon_destroy(struct powermon *pm);
+
+/**
+ * Add a sample. When a new epoch starts, all windows are cleared.
+ *
+ * @param pm the power monitor
+ * @param t timestamp of the sample in nanoseconds
+ * @param epoch epoch of the sample
+ * @param value ADC count
+ */
+void powermon_add(struct powermon *pm, uint64_t t, uint64_t epoch,
+		  uint16_t value);
+
+/**
+ * Power consumption estimated from the samples within a window
+ * (least-squares fit of V^2 over time).
+ *
+ * @param pm the power monitor
+ * @param window index of the window
+ * @return power in Watt, or 0 if the window contains less than two samples.
+ */
+double powermon_power(const struct powermon *pm, int window);
+
+/**
+ * Time covered by the samples within a window. Less than the width of the
+ * window at the beginning of an epoch, or if the window is limited by its
+ * maximum number of samples.
+ *
+ * @param pm the power monitor
+ * @param window index of the window
+ * @return time between the oldest and the latest sample of the window in
+ * seconds, or 0 if the window contains less than two samples.
+ */
+double powermon_span(const struct powermon *pm, int window);
+
+#endif
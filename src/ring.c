@@ -18,14 +18,27 @@
 
 #include "ring.h"
 
-void ring_init(struct ring *r)
+#include <stdlib.h>
+
+int ring_init(struct ring *r, unsigned int size)
 {
+     if (size == 0 || (size & (size-1)) != 0)
+	  return -1;
+     r->entries = malloc(size*sizeof(struct ring_entry));
+     if (r->entries == NULL)
+	  return -1;
+     r->size = size;
+     r->modmask = size-1;
+     r->head = 0;
+     r->tail = 0;
      r->entrycnt = 0;
      
      pthread_mutex_init(&r->mutex, NULL);
      
      pthread_cond_init(&r->notempty, NULL);
      pthread_cond_init(&r->notfull, NULL);
+
+     return 0;
 }
 
 void ring_destroy(struct ring* r)
@@ -34,23 +47,29 @@ void ring_destroy(struct ring* r)
      pthread_cond_destroy(&r->notfull);
 
      pthread_mutex_destroy(&r->mutex);
+
+     free(r->entries);
 }
 
-void ring_put(struct ring *r, const struct ring_entry *e)
+unsigned int ring_put(struct ring *r, const struct ring_entry *e)
 {
      pthread_mutex_lock(&r->mutex);
      
-     while (r->entrycnt == RING_SIZE) {
+     while (r->entrycnt == r->size) {
 	  pthread_cond_wait(&r->notfull, &r->mutex);
      }
 
      r->entries[r->head] = *e;
      r->entrycnt++;
-     r->head = (r->head+1) & RING_SIZE_MODMASK;
+     r->head = (r->head+1) & r->modmask;
+
+     unsigned int entrycnt = r->entrycnt;
 
      pthread_cond_signal(&r->notempty);
      
      pthread_mutex_unlock(&r->mutex);
+
+     return entrycnt;
 }
 
 void ring_get(struct ring *r, struct ring_entry *e)
@@ -63,10 +82,62 @@ void ring_get(struct ring *r, struct ring_entry *e)
 
      *e = r->entries[r->tail];
      r->entrycnt--;
-     r->tail = (r->tail+1) & RING_SIZE_MODMASK;
+     r->tail = (r->tail+1) & r->modmask;
      
      pthread_cond_signal(&r->notfull);
 	  
      pthread_mutex_unlock(&r->mutex);
 }
 
+unsigned int ring_put_batch(struct ring *r, const struct ring_entry *e,
+			    unsigned int n)
+{
+     pthread_mutex_lock(&r->mutex);
+
+     while (n > 0) {
+	  while (r->entrycnt == r->size) {
+	       pthread_cond_wait(&r->notfull, &r->mutex);
+	  }
+
+	  unsigned int free = r->size-r->entrycnt;
+	  unsigned int m = (n < free ? n : free);
+	  for (unsigned int i = 0; i < m; i++) {
+	       r->entries[r->head] = e[i];
+	       r->head = (r->head+1) & r->modmask;
+	  }
+	  r->entrycnt += m;
+	  e += m;
+	  n -= m;
+
+	  pthread_cond_signal(&r->notempty);
+     }
+
+     unsigned int entrycnt = r->entrycnt;
+     
+     pthread_mutex_unlock(&r->mutex);
+
+     return entrycnt;
+}
+
+unsigned int ring_get_batch(struct ring *r, struct ring_entry *e,
+			    unsigned int max)
+{
+     pthread_mutex_lock(&r->mutex);
+
+     while (r->entrycnt == 0) {
+	  pthread_cond_wait(&r->notempty, &r->mutex);
+     }
+
+     unsigned int n = (r->entrycnt < max ? r->entrycnt : max);
+     for (unsigned int i = 0; i < n; i++) {
+	  e[i] = r->entries[r->tail];
+	  r->tail = (r->tail+1) & r->modmask;
+     }
+     r->entrycnt -= n;
+     
+     pthread_cond_signal(&r->notfull);
+	  
+     pthread_mutex_unlock(&r->mutex);
+
+     return n;
+}
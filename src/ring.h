@@ -22,20 +22,34 @@
 #include <pthread.h>
 #include <stdint.h>
 
-/* At a sampling rate of 1000 Hz, we can buffer more than 8 seconds of samples.
-   If the logging thread cannot chatch up in this timespan, the systems is
-   definitely too slow for the sampling rate. */
+/* Default size of a ring. At a sampling rate of 1000 Hz, we can buffer more
+   than 8 seconds of samples. If the logging thread cannot chatch up in this
+   timespan, the systems is definitely too slow for the sampling rate. */
 #define RING_SIZE 8192
-#define RING_SIZE_MODMASK ((RING_SIZE)-1)
+
+/* Types of ring entries: samples of the discharging phase, samples
+   taken during relay transitions to the discharging and charging phase,
+   and the start of the sampling schedule of an epoch (timestamp: time of
+   tick 0, tick: sampling frequency in 1/1000 Hz). */
+#define RING_ENTRY_SAMPLE 0
+#define RING_ENTRY_TO_DISCHARGING 1
+#define RING_ENTRY_TO_CHARGING 2
+#define RING_ENTRY_SCHEDULE 3
 
 struct ring_entry {
      uint64_t timestamp;
      uint64_t epoch;
      uint16_t value;
+     uint16_t type;
+     /* Tick of the sampling schedule of the epoch (lower 32 bits). Uses
+	otherwise padded space, so entries do not grow. */
+     uint32_t tick;
 };
 
 struct ring {
-     struct ring_entry entries[RING_SIZE];
+     struct ring_entry *entries;
+     unsigned int size;
+     unsigned int modmask;
 
      unsigned int head;
      unsigned int tail;
@@ -52,8 +66,10 @@ struct ring {
  * Initialize new ring.
  * 
  * @param r the ring to be initialized
+ * @param size number of entries (power of 2)
+ * @return 0 on success, or -1 in case of an error.
  */
-void ring_init(struct ring *r);
+int ring_init(struct ring *r, unsigned int size);
 
 /**
  * Destroy a ring.
@@ -67,8 +83,9 @@ void ring_destroy(struct ring* r);
  * 
  * @param r the ring
  * @param e the entry to be added
+ * @return number of entries in the ring after adding the entry
  */
-void ring_put(struct ring *r, const struct ring_entry *e);
+unsigned int ring_put(struct ring *r, const struct ring_entry *e);
 
 /**
  * Get and remove an entry from a ring.
@@ -78,4 +95,27 @@ void ring_put(struct ring *r, const struct ring_entry *e);
  */
 void ring_get(struct ring *r, struct ring_entry *e);
 
+/**
+ * Add several entries to a ring. Waits until all entries have been added.
+ * 
+ * @param r the ring
+ * @param e the entries to be added
+ * @param n number of entries
+ * @return number of entries in the ring after adding the last entry
+ */
+unsigned int ring_put_batch(struct ring *r, const struct ring_entry *e,
+			    unsigned int n);
+
+/**
+ * Get and remove up to max entries from a ring. Waits until at least one
+ * entry is available.
+ * 
+ * @param r the ring
+ * @param e array to copy the entries to
+ * @param max maximum number of entries
+ * @return number of entries copied
+ */
+unsigned int ring_get_batch(struct ring *r, struct ring_entry *e,
+			    unsigned int max);
+
 #endif
@@ -0,0 +1,211 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "rtcheck.h"
+
+#include <stddef.h>
+
+/* Allocator calls of the calling thread, counted if the thread is
+   checked. */
+static __thread bool is_checked_thread = false;
+static __thread uint64_t alloc_count = 0;
+
+#ifdef RTCHECK_ALLOC
+
+#include <errno.h>
+
+/* Allocator functions of the C library (glibc). */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+const bool rtcheck_counts_allocs = true;
+
+static inline void count_alloc(void)
+{
+     if (is_checked_thread)
+	  alloc_count++;
+}
+
+void *malloc(size_t size)
+{
+     count_alloc();
+     return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+     count_alloc();
+     return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+     count_alloc();
+     return __libc_realloc(ptr, size);
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+     count_alloc();
+     if (size != 0 && nmemb > SIZE_MAX/size) {
+	  errno = ENOMEM;
+	  return NULL;
+     }
+     return __libc_realloc(ptr, nmemb*size);
+}
+
+void free(void *ptr)
+{
+     // free(NULL) does not call the allocator.
+     if (ptr == NULL)
+	  return;
+     count_alloc();
+     __libc_free(ptr);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+     count_alloc();
+     if (alignment % sizeof(void *) != 0 ||
+	 (alignment & (alignment-1)) != 0 || alignment == 0)
+	  return EINVAL;
+     void *p = __libc_memalign(alignment, size);
+     if (p == NULL)
+	  return ENOMEM;
+     *memptr = p;
+     return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+     count_alloc();
+     return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+     count_alloc();
+     return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+     count_alloc();
+     return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size)
+{
+     count_alloc();
+     return __libc_pvalloc(size);
+}
+
+#else
+
+const bool rtcheck_counts_allocs = false;
+
+#endif
+
+void rtcheck_init(struct rtcheck *rc, uint64_t interval_ns)
+{
+     rc->interval_ns = interval_ns;
+     rc->head = 0;
+     rc->tail = 0;
+     rc->dropped = 0;
+     rc->intervals = 0;
+     rc->violations = 0;
+}
+
+void rtcheck_start(struct rtcheck *rc, uint64_t t)
+{
+     is_checked_thread = true;
+     rc->t_start = t;
+     rc->iterations = 0;
+     rc->allocs = alloc_count;
+     getrusage(RUSAGE_THREAD, &rc->usage);
+}
+
+void rtcheck_end_interval(struct rtcheck *rc, uint64_t t)
+{
+     struct rusage usage;
+     getrusage(RUSAGE_THREAD, &usage);
+
+     struct rtcheck_report report;
+     report.t_start = rc->t_start;
+     report.t_end = t;
+     report.iterations = rc->iterations;
+     report.minflt = usage.ru_minflt-rc->usage.ru_minflt;
+     report.majflt = usage.ru_majflt-rc->usage.ru_majflt;
+     // One voluntary context switch per iteration is sleeping until the
+     // next iteration.
+     report.nvcsw = usage.ru_nvcsw-rc->usage.ru_nvcsw;
+     report.nvcsw = (report.nvcsw > (long) rc->iterations ?
+		     report.nvcsw-(long) rc->iterations : 0);
+     report.nivcsw = usage.ru_nivcsw-rc->usage.ru_nivcsw;
+     report.allocs = alloc_count-rc->allocs;
+
+     rc->t_start = t;
+     rc->iterations = 0;
+     rc->usage = usage;
+     rc->allocs = alloc_count;
+     __atomic_store_n(&rc->intervals, rc->intervals+1, __ATOMIC_RELAXED);
+
+     if (report.minflt == 0 && report.majflt == 0 && report.nvcsw == 0 &&
+	 report.nivcsw == 0 && report.allocs == 0)
+	  return;
+
+     __atomic_store_n(&rc->violations, rc->violations+1, __ATOMIC_RELAXED);
+     uint32_t tail = __atomic_load_n(&rc->tail, __ATOMIC_ACQUIRE);
+     if (rc->head-tail == RTCHECK_QUEUE_SIZE) {
+	  __atomic_store_n(&rc->dropped, rc->dropped+1, __ATOMIC_RELAXED);
+	  return;
+     }
+     rc->reports[rc->head & (RTCHECK_QUEUE_SIZE-1)] = report;
+     __atomic_store_n(&rc->head, rc->head+1, __ATOMIC_RELEASE);
+}
+
+bool rtcheck_get(struct rtcheck *rc, struct rtcheck_report *report)
+{
+     uint32_t head = __atomic_load_n(&rc->head, __ATOMIC_ACQUIRE);
+     if (head == rc->tail)
+	  return false;
+
+     *report = rc->reports[rc->tail & (RTCHECK_QUEUE_SIZE-1)];
+     __atomic_store_n(&rc->tail, rc->tail+1, __ATOMIC_RELEASE);
+
+     return true;
+}
+
+void rtcheck_print(FILE *f, const struct rtcheck_report *report)
+{
+     fprintf(f, "RT violation in [%llu, %llu] ns (%llu iterations): "
+	     "%ld minor faults, %ld major faults, %ld voluntary switches, "
+	     "%ld involuntary switches, %llu allocator calls\n",
+	     (unsigned long long) report->t_start,
+	     (unsigned long long) report->t_end,
+	     (unsigned long long) report->iterations, report->minflt,
+	     report->majflt, report->nvcsw, report->nivcsw,
+	     (unsigned long long) report->allocs);
+}
@@ -0,0 +1,149 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef RTCHECK_H
+#define RTCHECK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+/* Number of violation reports buffered for the reporting thread. Must be
+   a power of 2. */
+#define RTCHECK_QUEUE_SIZE 64
+
+/**
+ * Activity of the checked thread within one check interval that violates
+ * real-time safety. Times are in nanoseconds.
+ */
+struct rtcheck_report {
+     /* Start and end of the interval */
+     uint64_t t_start;
+     uint64_t t_end;
+     /* Iterations of the checked loop within the interval */
+     uint64_t iterations;
+     /* Page faults not requiring / requiring I/O */
+     long minflt;
+     long majflt;
+     /* Voluntary context switches exceeding one per iteration (sleeping
+	until the next iteration), and involuntary context switches
+	(preemption) */
+     long nvcsw;
+     long nivcsw;
+     /* Allocator calls (only counted if rtcheck_counts_allocs) */
+     uint64_t allocs;
+};
+
+/**
+ * Real-time safety checker of a thread.
+ *
+ * The checked thread counts its iterations and, once per check interval,
+ * reads its page faults and context switches (getrusage() with
+ * RUSAGE_THREAD) and the number of its allocator calls. Allocator calls are
+ * only counted if compiled with RTCHECK_ALLOC (debug build
+ * low-energy-meter-rtcheck): then, wrappers of all allocation and
+ * deallocation functions of the C library replace these functions for the
+ * whole process but count calls of the checked thread only. If the thread
+ * has page-faulted, has been preempted, has blocked besides sleeping once
+ * per iteration, or has called the allocator within an interval, a report
+ * is queued without locks; a reporting thread prints the reports. If the
+ * queue is full, the report is counted as dropped.
+ */
+struct rtcheck {
+     uint64_t interval_ns;
+     /* State of the current interval. Only accessed by the checked
+	thread. */
+     uint64_t t_start;
+     uint64_t iterations;
+     struct rusage usage;
+     uint64_t allocs;
+     /* Queue of reports: head is written by the checked thread, tail by
+	the reporting thread. */
+     struct rtcheck_report reports[RTCHECK_QUEUE_SIZE];
+     uint32_t head;
+     uint32_t tail;
+     uint32_t dropped;
+     /* Number of intervals checked and violating intervals. */
+     uint64_t intervals;
+     uint64_t violations;
+};
+
+/* True if allocator calls are counted (RTCHECK_ALLOC). */
+extern const bool rtcheck_counts_allocs;
+
+/**
+ * Initialize a real-time safety checker.
+ *
+ * @param rc the checker
+ * @param interval_ns check interval [ns]
+ */
+void rtcheck_init(struct rtcheck *rc, uint64_t interval_ns);
+
+/**
+ * Start checking the calling thread.
+ *
+ * @param rc the checker
+ * @param t current time [ns]
+ */
+void rtcheck_start(struct rtcheck *rc, uint64_t t);
+
+/**
+ * End the current check interval and start the next one. Must only be
+ * called by the checked thread.
+ *
+ * @param rc the checker
+ * @param t current time [ns]
+ */
+void rtcheck_end_interval(struct rtcheck *rc, uint64_t t);
+
+/**
+ * Count an iteration of the checked thread. Must only be called by the
+ * checked thread.
+ *
+ * @param rc the checker
+ * @param t current time [ns]
+ */
+static inline void rtcheck_iteration(struct rtcheck *rc, uint64_t t)
+{
+     rc->iterations++;
+     if (t >= rc->t_start+rc->interval_ns)
+	  rtcheck_end_interval(rc, t);
+}
+
+/**
+ * Take the oldest queued report. Must only be called by the reporting
+ * thread.
+ *
+ * @param rc the checker
+ * @param report the report
+ * @return true if a report was taken, false if the queue is empty.
+ */
+bool rtcheck_get(struct rtcheck *rc, struct rtcheck_report *report);
+
+/**
+ * Print a report as a line of text.
+ *
+ * @param f output file
+ * @param report the report
+ */
+void rtcheck_print(FILE *f, const struct rtcheck_report *report);
+
+#endif
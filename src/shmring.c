@@ -0,0 +1,205 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "shmring.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t map_size(uint32_t size)
+{
+     return sizeof(struct shmring_header)+size*sizeof(struct shmring_slot);
+}
+
+int shmring_writer_open(struct shmring_writer *w, const char *name)
+{
+     w->name = malloc(strlen(name)+1);
+     if (w->name == NULL)
+	  return -1;
+     strcpy(w->name, name);
+     
+     int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+     if (fd == -1) {
+	  free(w->name);
+	  return -1;
+     }
+
+     w->mapsize = map_size(SHMRING_SIZE);
+     if (ftruncate(fd, w->mapsize) == -1) {
+	  close(fd);
+	  shm_unlink(name);
+	  free(w->name);
+	  return -1;
+     }
+
+     void *map = mmap(NULL, w->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+     close(fd);
+     if (map == MAP_FAILED) {
+	  shm_unlink(name);
+	  free(w->name);
+	  return -1;
+     }
+
+     /* The shared-memory object is zero-filled, so all sequence counters are
+	initially invalid. */
+     w->header = (struct shmring_header *) map;
+     w->slots = (struct shmring_slot *) (w->header+1);
+     w->head = 0;
+     w->header->size = SHMRING_SIZE;
+     w->header->closed = 0;
+     w->header->head = 0;
+     /* Readers check the magic last. */
+     __atomic_thread_fence(__ATOMIC_RELEASE);
+     strcpy(w->header->magic, SHMRING_MAGIC);
+
+     return 0;
+}
+
+void shmring_writer_put(struct shmring_writer *w, const struct ring_entry *e)
+{
+     struct shmring_slot *slot = &w->slots[w->head & (SHMRING_SIZE-1)];
+     uint32_t seq = 2*w->head;
+
+     __atomic_store_n(&slot->seq, seq+1, __ATOMIC_RELAXED);
+     __atomic_thread_fence(__ATOMIC_RELEASE);
+     slot->timestamp = e->timestamp;
+     slot->epoch = e->epoch;
+     slot->value = e->value;
+     __atomic_store_n(&slot->seq, seq+2, __ATOMIC_RELEASE);
+
+     w->head++;
+     __atomic_store_n(&w->header->head, w->head, __ATOMIC_RELEASE);
+}
+
+void shmring_writer_close(struct shmring_writer *w)
+{
+     __atomic_store_n(&w->header->closed, 1, __ATOMIC_RELEASE);
+     munmap(w->header, w->mapsize);
+     shm_unlink(w->name);
+     free(w->name);
+}
+
+int shmring_reader_open(struct shmring_reader *r, const char *name,
+			bool from_oldest)
+{
+     int fd = shm_open(name, O_RDONLY, 0);
+     if (fd == -1)
+	  return -1;
+
+     struct stat st;
+     if (fstat(fd, &st) == -1 ||
+	 st.st_size < (off_t) sizeof(struct shmring_header)) {
+	  close(fd);
+	  return -1;
+     }
+     r->mapsize = st.st_size;
+
+     void *map = mmap(NULL, r->mapsize, PROT_READ, MAP_SHARED, fd, 0);
+     close(fd);
+     if (map == MAP_FAILED)
+	  return -1;
+
+     r->header = (const struct shmring_header *) map;
+     r->slots = (const struct shmring_slot *) (r->header+1);
+     if (strncmp(r->header->magic, SHMRING_MAGIC, sizeof(r->header->magic))) {
+	  munmap(map, r->mapsize);
+	  return -1;
+     }
+     __atomic_thread_fence(__ATOMIC_ACQUIRE);
+     r->size = r->header->size;
+     if (r->size == 0 || (r->size & (r->size-1)) != 0 ||
+	 map_size(r->size) > r->mapsize) {
+	  munmap(map, r->mapsize);
+	  return -1;
+     }
+
+     uint32_t head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+     if (from_oldest && head > r->size)
+	  r->next = head-r->size;
+     else if (from_oldest)
+	  r->next = 0;
+     else
+	  r->next = head;
+     r->lost = 0;
+
+     return 0;
+}
+
+/**
+ * Skip ahead after the writer has overtaken the reader. Skipping to the
+ * middle of the ring leaves the reader some time to catch up before it is
+ * overtaken again.
+ */
+static void skip_ahead(struct shmring_reader *r)
+{
+     uint32_t head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+     uint32_t next = head-r->size/2;
+
+     if ((int32_t) (next-r->next) <= 0)
+	  next = r->next+1;
+     r->lost += next-r->next;
+     r->next = next;
+}
+
+bool shmring_reader_next(struct shmring_reader *r, struct ring_entry *e)
+{
+     while (true) {
+	  uint32_t head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+	  if (head == r->next)
+	       return false;
+	  if (head-r->next > r->size) {
+	       skip_ahead(r);
+	       continue;
+	  }
+
+	  const struct shmring_slot *slot =
+	       &r->slots[r->next & (r->size-1)];
+	  uint32_t seq = 2*r->next+2;
+	  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq) {
+	       e->timestamp = slot->timestamp;
+	       e->epoch = slot->epoch;
+	       e->value = slot->value;
+	       e->type = RING_ENTRY_SAMPLE;
+	       e->tick = 0;
+	       __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	       if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+		    r->next++;
+		    return true;
+	       }
+	  }
+	  
+	  /* Slot has been overwritten by a newer record. */
+	  skip_ahead(r);
+     }
+}
+
+bool shmring_reader_closed(const struct shmring_reader *r)
+{
+     return (__atomic_load_n(&r->header->closed, __ATOMIC_ACQUIRE) != 0);
+}
+
+void shmring_reader_close(struct shmring_reader *r)
+{
+     munmap((void *) r->header, r->mapsize);
+}
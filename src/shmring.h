@@ -0,0 +1,155 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring.h"
+
+/* At a sampling rate of 1000 Hz, readers can fall behind by about one minute
+   before samples are overwritten. Must be a power of 2. */
+#define SHMRING_SIZE 65536
+
+#define SHMRING_MAGIC "LEMSHM1"
+
+/**
+ * Header of a shared-memory ring.
+ *
+ * Records are numbered consecutively. head is the number of records
+ * published so far; record n is stored in slot n modulo size. Counters are
+ * 32 bit, so they can be accessed atomically on any platform, and wrap
+ * around safely since only differences are evaluated.
+ */
+struct shmring_header {
+     char magic[8];
+     uint32_t size;
+     uint32_t closed;
+     uint32_t head;
+     uint32_t reserved;
+};
+
+/**
+ * Slot of a shared-memory ring.
+ *
+ * The sequence counter of a slot is 2n+1 while record n is written, and 2n+2
+ * after record n has been written completely. A reader detects that a slot
+ * has been overwritten (or is being overwritten) while reading it by
+ * comparing the sequence counter before and after copying the slot.
+ */
+struct shmring_slot {
+     uint32_t seq;
+     uint16_t value;
+     uint16_t reserved;
+     uint64_t timestamp;
+     uint64_t epoch;
+};
+
+/**
+ * Writer publishing samples to a shared-memory ring. There must only be a
+ * single writer. The writer never waits for readers.
+ */
+struct shmring_writer {
+     char *name;
+     struct shmring_header *header;
+     struct shmring_slot *slots;
+     uint32_t head;
+     size_t mapsize;
+};
+
+/**
+ * Reader following a shared-memory ring (read-only).
+ */
+struct shmring_reader {
+     const struct shmring_header *header;
+     const struct shmring_slot *slots;
+     uint32_t size;
+     uint32_t next;
+     uint64_t lost;
+     size_t mapsize;
+};
+
+/**
+ * Create a new shared-memory ring. An existing ring with the same name is
+ * replaced.
+ *
+ * @param w the writer
+ * @param name name of the shared-memory object (e.g., "/lem")
+ * @return 0 on success, or -1 in case of an error (errno is set).
+ */
+int shmring_writer_open(struct shmring_writer *w, const char *name);
+
+/**
+ * Publish a sample.
+ *
+ * @param w the writer
+ * @param e the sample
+ */
+void shmring_writer_put(struct shmring_writer *w, const struct ring_entry *e);
+
+/**
+ * Mark the ring as closed and remove the shared-memory object. Attached
+ * readers can still read the remaining samples.
+ *
+ * @param w the writer
+ */
+void shmring_writer_close(struct shmring_writer *w);
+
+/**
+ * Attach to an existing shared-memory ring.
+ *
+ * @param r the reader
+ * @param name name of the shared-memory object
+ * @param from_oldest start reading from the oldest sample in the ring
+ * instead of the next sample published
+ * @return 0 on success, or -1 in case of an error or invalid ring.
+ */
+int shmring_reader_open(struct shmring_reader *r, const char *name,
+			bool from_oldest);
+
+/**
+ * Read the next sample. If the reader has fallen behind so far that samples
+ * have been overwritten, it skips ahead to the middle of the ring and adds
+ * the number of skipped samples to r->lost.
+ *
+ * @param r the reader
+ * @param e structure to copy the sample to
+ * @return true if a sample was read, or false if no new sample is
+ * available.
+ */
+bool shmring_reader_next(struct shmring_reader *r, struct ring_entry *e);
+
+/**
+ * Check whether the writer has closed the ring.
+ *
+ * @param r the reader
+ * @return true if the ring has been closed.
+ */
+bool shmring_reader_closed(const struct shmring_reader *r);
+
+/**
+ * Detach from a shared-memory ring.
+ *
+ * @param r the reader
+ */
+void shmring_reader_close(struct shmring_reader *r);
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "simadc.h"
+#include "energy.h"
+
+#include <math.h>
+#include <time.h>
+
+static uint64_t now()
+{
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+     return (uint64_t) t.tv_sec*1000000000ull+t.tv_nsec;
+}
+
+/**
+ * Advance the simulated capacitor voltage to the current time.
+ */
+static void update(struct simadc *a)
+{
+     uint64_t t = now();
+     double dt = (t-a->t)/1000000000.0;
+     a->t = t;
+
+     if (a->charging) {
+	  a->voltage = SUPPLY_VOLTAGE-(SUPPLY_VOLTAGE-a->voltage)*
+	       exp(-dt/(CHARGE_RESISTANCE*CAPACITANCE));
+     } else if (a->discharging) {
+	  /* Constant power: V^2 decreases linearly with slope -2*P/C. */
+	  double v2 = a->voltage*a->voltage-2.0*SIMADC_POWER/CAPACITANCE*dt;
+	  a->voltage = (v2 > 0.0 ? sqrt(v2) : 0.0);
+     }
+}
+
+void simadc_init(struct simadc *a)
+{
+     a->voltage = 0.0;
+     a->t = now();
+     a->charging = false;
+     a->discharging = false;
+     a->seed = 1;
+}
+
+void simadc_set_relay(struct simadc *a, bool charge_relay, bool closed)
+{
+     update(a);
+     if (charge_relay)
+	  a->charging = closed;
+     else
+	  a->discharging = closed;
+}
+
+int16_t simadc_sample(struct simadc *a)
+{
+     update(a);
+
+     /* Linear congruential generator for uniform noise. */
+     a->seed = a->seed*1103515245u+12345u;
+     int noise = (int) ((a->seed >> 16)%(2*SIMADC_NOISE+1))-SIMADC_NOISE;
+     
+     int count = (int) (a->voltage/ADC_FULL_SCALE_VOLTAGE*ADC_MAX_COUNT+0.5)+
+	  noise;
+     if (count < 0)
+	  count = 0;
+     else if (count > ADC_MAX_COUNT)
+	  count = ADC_MAX_COUNT;
+
+     return count;
+}
@@ -0,0 +1,72 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SIMADC_H
+#define SIMADC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constant power consumption of the simulated device under test [W]. With
+   thresholds of 2 V and 3 V, an epoch lasts 1 s. */
+#define SIMADC_POWER 0.025
+
+/* Maximum ADC noise [ADC counts]. */
+#define SIMADC_NOISE 2
+
+/**
+ * Synthetic ADC measuring the voltage of a simulated supply capacitor, which
+ * is charged through the charge relay and discharged by a device with
+ * constant power consumption through the discharge relay. Replaces the
+ * measurement board for testing without hardware.
+ */
+struct simadc {
+     double voltage;
+     uint64_t t;
+     bool charging;
+     bool discharging;
+     uint32_t seed;
+};
+
+/**
+ * Initialize a synthetic ADC with a discharged capacitor and open relays.
+ *
+ * @param a the ADC
+ */
+void simadc_init(struct simadc *a);
+
+/**
+ * Open or close a relay.
+ *
+ * @param a the ADC
+ * @param charge_relay true for the charge relay, false for the discharge
+ * relay
+ * @param closed true to close the relay
+ */
+void simadc_set_relay(struct simadc *a, bool charge_relay, bool closed);
+
+/**
+ * Take a sample of the capacitor voltage at the current time.
+ *
+ * @param a the ADC
+ * @return ADC count
+ */
+int16_t simadc_sample(struct simadc *a);
+
+#endif
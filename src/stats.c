@@ -0,0 +1,96 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+static const char *names[STATS_COUNT] = {
+     "samples_taken",
+     "samples_logged",
+     "adc_errors",
+     "relay_switches",
+     "epochs",
+     "deadline_misses",
+     "ring_full",
+     "ring_high_water",
+     "wakeup_latency_max_ns",
+     "log_latency_max_ns",
+     "break_time_max_ns"
+};
+
+/* Counters aggregated by maximum instead of sum. */
+static const bool is_max[STATS_COUNT] = {
+     [STATS_RING_HIGH_WATER] = true,
+     [STATS_WAKEUP_LATENCY_MAX] = true,
+     [STATS_LOG_LATENCY_MAX] = true,
+     [STATS_BREAK_TIME_MAX] = true
+};
+
+static uint64_t now()
+{
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+     return (uint64_t) t.tv_sec*1000000000ull+t.tv_nsec;
+}
+
+void stats_init(struct stats *s)
+{
+     memset(s->threads, 0, sizeof(s->threads));
+     s->t_start = now();
+}
+
+void stats_snapshot(const struct stats *s, struct stats_snapshot *snap)
+{
+     snap->t = now();
+     for (int c = 0; c < STATS_COUNT; c++) {
+	  snap->counters[c] = 0;
+	  for (int i = 0; i < STATS_THREADS; i++) {
+	       uint64_t v = __atomic_load_n(&s->threads[i].counters[c],
+					    __ATOMIC_RELAXED);
+	       if (!is_max[c])
+		    snap->counters[c] += v;
+	       else if (v > snap->counters[c])
+		    snap->counters[c] = v;
+	  }
+     }
+}
+
+void stats_print(FILE *f, const struct stats *s,
+		 const struct stats_snapshot *cur,
+		 const struct stats_snapshot *prev, bool one_line)
+{
+     const char *fmt = (one_line ? "%s=%llu " : "%s %llu\n");
+     
+     double uptime = (cur->t-s->t_start)/1000000000.0;
+     double rate = 0.0;
+     if (prev != NULL && cur->t > prev->t)
+	  rate = (cur->counters[STATS_SAMPLES_TAKEN]-
+		  prev->counters[STATS_SAMPLES_TAKEN])/
+	       ((cur->t-prev->t)/1000000000.0);
+     else if (prev == NULL && uptime > 0.0)
+	  rate = cur->counters[STATS_SAMPLES_TAKEN]/uptime;
+     
+     fprintf(f, (one_line ? "uptime=%.3f " : "uptime %.3f\n"), uptime);
+     for (int c = 0; c < STATS_COUNT; c++)
+	  fprintf(f, fmt, names[c], (unsigned long long) cur->counters[c]);
+     fprintf(f, (one_line ? "sample_rate=%.1f\n" : "sample_rate %.1f\n"),
+	     rate);
+}
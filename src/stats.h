@@ -0,0 +1,143 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Runtime counters. */
+enum stats_counter {
+     STATS_SAMPLES_TAKEN,
+     STATS_SAMPLES_LOGGED,
+     STATS_ADC_ERRORS,
+     STATS_RELAY_SWITCHES,
+     STATS_EPOCHS,
+     /* Samples taken later than one sampling interval after the scheduled
+	sampling time. */
+     STATS_DEADLINE_MISSES,
+     /* Samples after which the ring was full, i.e., the sampling thread
+	would block on the next sample. */
+     STATS_RING_FULL,
+     /* Maximum number of entries in the ring between sampling and logger
+	thread. */
+     STATS_RING_HIGH_WATER,
+     /* Maximum delay of the sampling thread after the scheduled sampling
+	time. */
+     STATS_WAKEUP_LATENCY_MAX,
+     /* Maximum delay between taking and logging a sample. */
+     STATS_LOG_LATENCY_MAX,
+     /* Maximum time both relays were open during a relay transition. */
+     STATS_BREAK_TIME_MAX,
+     STATS_COUNT
+};
+
+/* Threads updating counters. */
+enum stats_thread {STATS_SAMPLER, STATS_LOGGER, STATS_THREADS};
+
+/**
+ * Counters of one thread. Each block is only written by its thread and
+ * occupies its own cache line(s), so updating a counter is a plain
+ * (relaxed atomic) load and store without locks, atomic read-modify-write
+ * operations, or cache line bouncing between threads.
+ */
+struct stats_block {
+     uint64_t counters[STATS_COUNT];
+} __attribute__((aligned(64)));
+
+/**
+ * Runtime statistics.
+ */
+struct stats {
+     struct stats_block threads[STATS_THREADS];
+     uint64_t t_start;
+};
+
+/**
+ * Snapshot of the runtime statistics aggregated over all threads.
+ */
+struct stats_snapshot {
+     uint64_t t;
+     uint64_t counters[STATS_COUNT];
+};
+
+/**
+ * Initialize statistics.
+ *
+ * @param s the statistics
+ */
+void stats_init(struct stats *s);
+
+/**
+ * Increment a counter. Must only be called by the given thread.
+ *
+ * @param s the statistics
+ * @param thread the calling thread
+ * @param c the counter
+ * @param n increment
+ */
+static inline void stats_add(struct stats *s, enum stats_thread thread,
+			     enum stats_counter c, uint64_t n)
+{
+     uint64_t *p = &s->threads[thread].counters[c];
+     __atomic_store_n(p, *p+n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Update a maximum counter. Must only be called by the given thread.
+ *
+ * @param s the statistics
+ * @param thread the calling thread
+ * @param c the counter
+ * @param value new value
+ */
+static inline void stats_max(struct stats *s, enum stats_thread thread,
+			     enum stats_counter c, uint64_t value)
+{
+     uint64_t *p = &s->threads[thread].counters[c];
+     if (value > *p)
+	  __atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Take a snapshot of the statistics. Can be called by any thread.
+ *
+ * @param s the statistics
+ * @param snap the snapshot
+ */
+void stats_snapshot(const struct stats *s, struct stats_snapshot *snap);
+
+/**
+ * Print a snapshot.
+ *
+ * @param f output file
+ * @param s the statistics
+ * @param cur the snapshot
+ * @param prev previous snapshot for calculating the current sampling rate,
+ * or NULL to calculate the average rate since start
+ * @param one_line print "name=value" pairs on one line instead of one
+ * "name value" line per counter
+ */
+void stats_print(FILE *f, const struct stats *s,
+		 const struct stats_snapshot *cur,
+		 const struct stats_snapshot *prev, bool one_line);
+
+#endif
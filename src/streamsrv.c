@@ -0,0 +1,410 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "streamsrv.h"
+#include "energy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Update the statistics of the current epoch with a sample.
+ *
+ * @param s statistics of the current epoch
+ * @param e the sample
+ * @param summary summary of the previous epoch
+ * @return true if the sample starts a new epoch, i.e., a summary of the
+ * previous epoch has been created.
+ */
+static bool epoch_update(struct stream_epoch *s, const struct ring_entry *e,
+			 struct stream_record *summary)
+{
+     bool has_summary = false;
+     
+     if (s->valid && e->epoch != s->epoch) {
+	  memset(summary, 0, sizeof(*summary));
+	  summary->type = STREAM_SUMMARIES;
+	  summary->value = s->samples;
+	  summary->timestamp = s->t_first;
+	  summary->epoch = s->epoch;
+	  summary->duration = s->t_last-s->t_first;
+	  summary->energy = discharge_energy(s->value_first, s->value_last);
+	  if (summary->duration > 0)
+	       summary->power = summary->energy/
+		    (summary->duration/1000000000.0);
+	  summary->pfit = linfit_power(&s->fit);
+	  has_summary = true;
+	  s->valid = false;
+     }
+
+     if (!s->valid) {
+	  s->valid = true;
+	  s->epoch = e->epoch;
+	  s->t_first = e->timestamp;
+	  s->value_first = e->value;
+	  s->samples = 0;
+	  linfit_init(&s->fit);
+     }
+
+     s->samples++;
+     s->t_last = e->timestamp;
+     s->value_last = e->value;
+     double v = adc_to_voltage(e->value);
+     linfit_add(&s->fit, (e->timestamp-s->t_first)/1000000000.0, v*v);
+
+     return has_summary;
+}
+
+/**
+ * Add a record to the queue of a client. Samples are dropped if less than
+ * STREAMSRV_QUEUE_RESERVE slots are free; the number of dropped samples is
+ * reported to the client by an overrun record before the next sample.
+ *
+ * @param c the client
+ * @param rec the record
+ */
+static void enqueue(struct stream_client *c, const struct stream_record *rec)
+{
+     bool is_sample = (rec->type == STREAM_SAMPLES);
+     unsigned int limit = (is_sample ?
+			   STREAMSRV_QUEUE_SIZE-STREAMSRV_QUEUE_RESERVE :
+			   STREAMSRV_QUEUE_SIZE);
+
+     if (c->count >= limit) {
+	  if (is_sample)
+	       c->dropped++;
+	  return;
+     }
+
+     if (is_sample && c->dropped > 0) {
+	  struct stream_record *overrun = &c->queue[c->head];
+	  memset(overrun, 0, sizeof(*overrun));
+	  overrun->type = STREAM_OVERRUN;
+	  overrun->value = c->dropped;
+	  overrun->epoch = rec->epoch;
+	  overrun->timestamp = rec->timestamp;
+	  c->head = (c->head+1) & (STREAMSRV_QUEUE_SIZE-1);
+	  c->count++;
+	  c->dropped = 0;
+     }
+
+     c->queue[c->head] = *rec;
+     c->head = (c->head+1) & (STREAMSRV_QUEUE_SIZE-1);
+     c->count++;
+}
+
+void streamsrv_publish(struct streamsrv *srv, const struct ring_entry *e)
+{
+     /* Epoch statistics are only accessed by the logger thread. */
+     struct stream_record summary;
+     bool has_summary = epoch_update(&srv->current, e, &summary);
+
+     struct stream_record sample;
+     memset(&sample, 0, sizeof(sample));
+     sample.type = STREAM_SAMPLES;
+     sample.value = e->value;
+     sample.timestamp = e->timestamp;
+     sample.epoch = e->epoch;
+     
+     pthread_mutex_lock(&srv->mutex);
+     
+     for (unsigned int i = 0; i < srv->nclients; i++) {
+	  struct stream_client *c = &srv->clients[i];
+	  if (!c->subscribed)
+	       continue;
+	  
+	  bool filter = ((c->sub.flags & STREAM_EPOCH_FILTER) != 0);
+	  if (has_summary && (c->sub.flags & STREAM_SUMMARIES) &&
+	      (!filter || summary.epoch == c->sub.epoch))
+	       enqueue(c, &summary);
+	  
+	  if (!(c->sub.flags & STREAM_SAMPLES) ||
+	      (filter && e->epoch != c->sub.epoch))
+	       continue;
+	  if (e->epoch != c->last_epoch) {
+	       c->last_epoch = e->epoch;
+	       c->next_sample = 0;
+	  }
+	  if (e->timestamp >= c->next_sample) {
+	       enqueue(c, &sample);
+	       c->next_sample = e->timestamp+c->sub.interval_ns;
+	  }
+     }
+     
+     pthread_mutex_unlock(&srv->mutex);
+}
+
+/**
+ * Receive (part of) the subscription of a client, or detect that the
+ * client has closed the connection. The mutex is only held to activate
+ * the subscription; until then, the logger thread does not access the
+ * subscription.
+ *
+ * @return 0 on success, or -1 if the client has to be disconnected.
+ */
+static int receive(struct streamsrv *srv, struct stream_client *c)
+{
+     char buffer[sizeof(struct stream_subscription)];
+     char *dst = buffer;
+     size_t len = sizeof(buffer);
+     if (!c->subscribed) {
+	  dst = (char *) &c->sub+c->sub_received;
+	  len = sizeof(c->sub)-c->sub_received;
+     }
+
+     ssize_t n = recv(c->fd, dst, len, MSG_DONTWAIT);
+     if (n == 0)
+	  return -1;
+     if (n < 0)
+	  return ((errno == EAGAIN || errno == EWOULDBLOCK ||
+		   errno == EINTR) ? 0 : -1);
+
+     /* Data after the subscription is ignored. */
+     if (!c->subscribed) {
+	  c->sub_received += n;
+	  if (c->sub_received == sizeof(c->sub)) {
+	       pthread_mutex_lock(&srv->mutex);
+	       c->subscribed = true;
+	       c->next_sample = 0;
+	       c->last_epoch = 0;
+	       pthread_mutex_unlock(&srv->mutex);
+	  }
+     }
+
+     return 0;
+}
+
+/**
+ * Send as much of the queue of a client as possible without blocking. The
+ * mutex is only held to read and update the number of queued records, not
+ * while sending: the logger thread only adds records at the head of the
+ * queue, so records queued before are not modified.
+ *
+ * @return 0 on success, or -1 if the client has to be disconnected.
+ */
+static int transmit(struct streamsrv *srv, struct stream_client *c)
+{
+     while (true) {
+	  pthread_mutex_lock(&srv->mutex);
+	  unsigned int count = c->count;
+	  pthread_mutex_unlock(&srv->mutex);
+	  if (count == 0)
+	       break;
+	  
+	  /* Send the contiguous part of the queue at once. */
+	  unsigned int nrecords = STREAMSRV_QUEUE_SIZE-c->tail;
+	  if (nrecords > count)
+	       nrecords = count;
+	  const char *src = (const char *) &c->queue[c->tail]+c->sent;
+	  size_t len = nrecords*sizeof(struct stream_record)-c->sent;
+
+	  ssize_t n = send(c->fd, src, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	  if (n < 0)
+	       return ((errno == EAGAIN || errno == EWOULDBLOCK ||
+			errno == EINTR) ? 0 : -1);
+
+	  c->sent += n;
+	  unsigned int done = c->sent/sizeof(struct stream_record);
+	  c->sent %= sizeof(struct stream_record);
+	  c->tail = (c->tail+done) & (STREAMSRV_QUEUE_SIZE-1);
+	  pthread_mutex_lock(&srv->mutex);
+	  c->count -= done;
+	  pthread_mutex_unlock(&srv->mutex);
+	  if ((size_t) n < len)
+	       return 0;
+     }
+
+     return 0;
+}
+
+static void disconnect(struct stream_client *c)
+{
+     close(c->fd);
+     free(c->queue);
+}
+
+/**
+ * Accept a new client. The client is set up outside the mutex, since the
+ * logger thread only accesses the first nclients clients, which are only
+ * added and removed by the server thread.
+ */
+static void accept_client(struct streamsrv *srv)
+{
+     int fd = accept(srv->listen_fd, NULL, NULL);
+     if (fd == -1)
+	  return;
+     
+     struct stream_client *c = &srv->clients[srv->nclients];
+     if (srv->nclients == STREAMSRV_MAX_CLIENTS ||
+	 fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ||
+	 (c->queue = malloc(STREAMSRV_QUEUE_SIZE*
+			    sizeof(struct stream_record))) == NULL) {
+	  close(fd);
+	  return;
+     }
+
+     c->fd = fd;
+     c->subscribed = false;
+     c->sub_received = 0;
+     c->head = 0;
+     c->tail = 0;
+     c->count = 0;
+     c->sent = 0;
+     c->dropped = 0;
+     pthread_mutex_lock(&srv->mutex);
+     srv->nclients++;
+     pthread_mutex_unlock(&srv->mutex);
+}
+
+/**
+ * Main loop of the server thread.
+ */
+static void *server_loop(void *args)
+{
+     struct streamsrv *srv = (struct streamsrv *) args;
+     struct pollfd fds[STREAMSRV_MAX_CLIENTS+1];
+
+     while (true) {
+	  pthread_mutex_lock(&srv->mutex);
+	  if (srv->stop) {
+	       pthread_mutex_unlock(&srv->mutex);
+	       break;
+	  }
+	  fds[0].fd = srv->listen_fd;
+	  fds[0].events = POLLIN;
+	  unsigned int n = srv->nclients;
+	  for (unsigned int i = 0; i < n; i++) {
+	       const struct stream_client *c = &srv->clients[i];
+	       fds[i+1].fd = c->fd;
+	       fds[i+1].events = POLLIN | (c->count > 0 ? POLLOUT : 0);
+	  }
+	  pthread_mutex_unlock(&srv->mutex);
+
+	  /* New samples are picked up after the poll interval at the
+	     latest. */
+	  if (poll(fds, n+1, STREAMSRV_POLL_MS) == -1 && errno != EINTR)
+	       break;
+
+	  /* Only this thread adds or removes clients, so the first n
+	     clients still correspond to fds. Iterating backwards, removed
+	     clients can be replaced by the last client. The mutex is not
+	     held across system calls and allocations, which could block the
+	     logger thread for a long time. */
+	  for (unsigned int i = n; i-- > 0; ) {
+	       struct stream_client *c = &srv->clients[i];
+	       short revents = fds[i+1].revents;
+	       int status = 0;
+	       if (revents & (POLLIN | POLLHUP | POLLERR))
+		    status = receive(srv, c);
+	       if (status == 0)
+		    status = transmit(srv, c);
+	       if (status == -1) {
+		    pthread_mutex_lock(&srv->mutex);
+		    struct stream_client removed = *c;
+		    srv->clients[i] = srv->clients[--srv->nclients];
+		    pthread_mutex_unlock(&srv->mutex);
+		    disconnect(&removed);
+	       }
+	  }
+	  if (fds[0].revents & POLLIN)
+	       accept_client(srv);
+     }
+
+     return NULL;
+}
+
+int streamsrv_open(struct streamsrv *srv, const char *path)
+{
+     struct sockaddr_un addr;
+     memset(&addr, 0, sizeof(addr));
+     addr.sun_family = AF_UNIX;
+     if (strlen(path) >= sizeof(addr.sun_path)) {
+	  errno = ENAMETOOLONG;
+	  return -1;
+     }
+     strcpy(addr.sun_path, path);
+
+     srv->path = malloc(strlen(path)+1);
+     if (srv->path == NULL)
+	  return -1;
+     strcpy(srv->path, path);
+
+     srv->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+     if (srv->listen_fd == -1) {
+	  free(srv->path);
+	  return -1;
+     }
+
+     unlink(path);
+     if (bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+	 listen(srv->listen_fd, STREAMSRV_MAX_CLIENTS) == -1 ||
+	 fcntl(srv->listen_fd, F_SETFL,
+	       fcntl(srv->listen_fd, F_GETFL) | O_NONBLOCK) == -1) {
+	  close(srv->listen_fd);
+	  free(srv->path);
+	  return -1;
+     }
+
+     srv->stop = false;
+     srv->nclients = 0;
+     srv->current.valid = false;
+     /* The mutex is shared with the real-time logger thread. */
+     pthread_mutexattr_t attr;
+     pthread_mutexattr_init(&attr);
+     pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+     pthread_mutex_init(&srv->mutex, &attr);
+     pthread_mutexattr_destroy(&attr);
+
+     int err = pthread_create(&srv->thread, NULL, server_loop, srv);
+     if (err != 0) {
+	  pthread_mutex_destroy(&srv->mutex);
+	  close(srv->listen_fd);
+	  unlink(path);
+	  free(srv->path);
+	  errno = err;
+	  return -1;
+     }
+
+     return 0;
+}
+
+void streamsrv_close(struct streamsrv *srv)
+{
+     /* Cannot join ourselves, e.g., if a signal handler is executed by the
+	server thread. The process is terminated anyway. */
+     if (!pthread_equal(pthread_self(), srv->thread)) {
+	  pthread_mutex_lock(&srv->mutex);
+	  srv->stop = true;
+	  pthread_mutex_unlock(&srv->mutex);
+	  pthread_join(srv->thread, NULL);
+	  
+	  for (unsigned int i = 0; i < srv->nclients; i++)
+	       disconnect(&srv->clients[i]);
+	  srv->nclients = 0;
+	  close(srv->listen_fd);
+     }
+     
+     unlink(srv->path);
+}
@@ -0,0 +1,179 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef STREAMSRV_H
+#define STREAMSRV_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "linfit.h"
+#include "ring.h"
+
+/* Maximum number of concurrent subscribers. */
+#define STREAMSRV_MAX_CLIENTS 16
+
+/* Capacity of the queue of each subscriber (records). At a sampling rate of
+   1000 Hz, a subscriber may stall for about 4 seconds before samples are
+   dropped. Must be a power of 2. */
+#define STREAMSRV_QUEUE_SIZE 4096
+
+/* Queue slots reserved for summaries and overrun records, which are never
+   dropped in favor of samples. */
+#define STREAMSRV_QUEUE_RESERVE 16
+
+/* Polling interval of the server thread in milliseconds. */
+#define STREAMSRV_POLL_MS 10
+
+/* Record types and subscription flags. */
+#define STREAM_SAMPLES 1
+#define STREAM_SUMMARIES 2
+#define STREAM_OVERRUN 4
+
+/* Subscription flag: only stream the given epoch. */
+#define STREAM_EPOCH_FILTER 8
+
+/**
+ * Subscription sent by a client after connecting. Until the subscription
+ * has been received, nothing is sent to the client. Values are in host
+ * byte order.
+ */
+struct stream_subscription {
+     /* STREAM_SAMPLES and/or STREAM_SUMMARIES, optionally
+	STREAM_EPOCH_FILTER */
+     uint32_t flags;
+     uint32_t reserved;
+     /* Minimum time between two samples sent (decimation); 0 sends every
+	sample. */
+     uint64_t interval_ns;
+     /* Epoch to stream if STREAM_EPOCH_FILTER is set. */
+     uint64_t epoch;
+};
+
+/**
+ * Binary record streamed to clients in host byte order.
+ *
+ * - STREAM_SAMPLES: timestamp, epoch, and ADC count (value) of a sample.
+ * - STREAM_SUMMARIES: summary of an epoch, sent when the first sample of the
+ *   next epoch is logged. timestamp is the first sample, value the number of
+ *   samples, duration the time between first and last sample; energy and
+ *   power are calculated from the first and last sample, pfit is the fitted
+ *   power consumption (cf. lem-analyze).
+ * - STREAM_OVERRUN: value samples have been dropped since the client did
+ *   not read fast enough.
+ */
+struct stream_record {
+     uint32_t type;
+     uint32_t value;
+     uint64_t timestamp;
+     uint64_t epoch;
+     uint64_t duration;
+     double energy;
+     double power;
+     double pfit;
+};
+
+/**
+ * A connected client.
+ */
+struct stream_client {
+     int fd;
+     bool subscribed;
+     struct stream_subscription sub;
+     /* Bytes of the subscription received so far. */
+     size_t sub_received;
+
+     /* Decimation: earliest timestamp of the next sample sent. */
+     uint64_t next_sample;
+     uint64_t last_epoch;
+
+     struct stream_record *queue;
+     unsigned int head;
+     unsigned int tail;
+     unsigned int count;
+     /* Bytes of the record at the tail already sent. */
+     size_t sent;
+     uint32_t dropped;
+};
+
+/**
+ * Statistics of the current epoch for summaries.
+ */
+struct stream_epoch {
+     bool valid;
+     uint64_t epoch;
+     uint64_t t_first;
+     uint64_t t_last;
+     uint16_t value_first;
+     uint16_t value_last;
+     uint32_t samples;
+     struct linfit fit;
+};
+
+/**
+ * Server streaming samples and epoch summaries to clients connected to a
+ * Unix domain socket. Samples are published by the logger thread to
+ * bounded per-client queues, which are drained by a separate server thread,
+ * so slow clients never block the logger.
+ */
+struct streamsrv {
+     char *path;
+     int listen_fd;
+     
+     pthread_t thread;
+     /* Protects the number of clients, the activation of subscriptions, and
+	the number of queued records. Never held by the server thread across
+	system calls, since the logger thread has real-time priority. */
+     pthread_mutex_t mutex;
+     bool stop;
+     
+     struct stream_client clients[STREAMSRV_MAX_CLIENTS];
+     unsigned int nclients;
+
+     struct stream_epoch current;
+};
+
+/**
+ * Create the server socket and start the server thread. An existing socket
+ * file with the same path is replaced.
+ *
+ * @param srv the server
+ * @param path path of the Unix domain socket
+ * @return 0 on success, or -1 in case of an error (errno is set).
+ */
+int streamsrv_open(struct streamsrv *srv, const char *path);
+
+/**
+ * Publish a sample to all subscribed clients. Never blocks on clients.
+ *
+ * @param srv the server
+ * @param e the sample
+ */
+void streamsrv_publish(struct streamsrv *srv, const struct ring_entry *e);
+
+/**
+ * Stop the server thread (unless called from it), disconnect all clients,
+ * and remove the socket file.
+ *
+ * @param srv the server
+ */
+void streamsrv_close(struct streamsrv *srv);
+
+#endif
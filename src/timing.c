@@ -0,0 +1,115 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "timing.h"
+
+#include <math.h>
+
+struct timespec frequency_to_interval(double frequency)
+{
+     struct timespec itimespec;
+     
+     /* Calculate interval in nanoseconds.
+        A 64 bit value is enough for thousands of years sampling. */
+     uint64_t ins = (uint64_t) (1000000000.0/frequency + 0.5);
+
+     itimespec.tv_sec = ins/1000000000ull;
+     itimespec.tv_nsec = ins%1000000000ull;
+
+     return itimespec;
+}
+
+struct timespec next_sampling_time(struct timespec tlast,
+				   struct timespec interval)
+{
+     struct timespec tnext;
+     
+     tnext.tv_sec = tlast.tv_sec+interval.tv_sec;
+     tnext.tv_nsec = tlast.tv_nsec+interval.tv_nsec;
+
+     /* Normalize */
+     if (tnext.tv_nsec >= 1000000000l) {
+	  tnext.tv_sec++;
+	  tnext.tv_nsec -= 1000000000l;
+     }
+
+     return tnext;
+}
+
+uint64_t to_nanosec(struct timespec t)
+{
+     uint64_t t_ns = 1000000000ull*t.tv_sec;
+     t_ns += t.tv_nsec;
+
+     return t_ns;
+}
+
+struct timespec to_timespec(uint64_t t_ns)
+{
+     struct timespec t;
+     t.tv_sec = t_ns/1000000000ull;
+     t.tv_nsec = t_ns%1000000000ull;
+
+     return t;
+}
+
+int schedule_init(struct schedule *s, double frequency)
+{
+     if (!(frequency > 0.0 && frequency <= SCHEDULE_MAX_FREQUENCY))
+	  return -1;
+
+     s->num = (uint64_t) llround(frequency*SCHEDULE_FREQUENCY_SCALE);
+     if (s->num == 0)
+	  return -1;
+
+     s->period = 1000000000ull*SCHEDULE_FREQUENCY_SCALE/s->num;
+     s->rem = 1000000000ull*SCHEDULE_FREQUENCY_SCALE%s->num;
+     schedule_start(s, 0);
+
+     return 0;
+}
+
+void schedule_start(struct schedule *s, uint64_t t0)
+{
+     s->t0 = t0;
+     s->tick = 0;
+     s->t = t0;
+     s->acc = 0;
+}
+
+uint64_t schedule_advance(struct schedule *s, uint64_t ticks)
+{
+     s->tick += ticks;
+     s->t += ticks*s->period;
+     /* rem < num <= 1e9, so this does not overflow for any reasonable
+	number of ticks. */
+     s->acc += ticks*s->rem;
+     s->t += s->acc/s->num;
+     s->acc %= s->num;
+
+     return s->t;
+}
+
+uint64_t schedule_deadline(const struct schedule *s, uint64_t tick)
+{
+     /* floor(tick*rem/num) without overflowing 64 bit for large ticks. */
+     uint64_t frac = (tick/s->num)*s->rem + (tick%s->num)*s->rem/s->num;
+
+     return s->t0 + tick*s->period + frac;
+}
@@ -0,0 +1,121 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Frequencies of a schedule are represented in units of 1/1000 Hz. */
+#define SCHEDULE_FREQUENCY_SCALE 1000ull
+
+/* Maximum frequency of a schedule [Hz]. */
+#define SCHEDULE_MAX_FREQUENCY 1000000.0
+
+/**
+ * Drift-free periodic schedule. The period is the exact rational number
+ * 1e9*SCHEDULE_FREQUENCY_SCALE/num nanoseconds, i.e., an integral part
+ * period plus a fractional part rem/num. The fractional parts are
+ * accumulated, so the deadline of tick k is exactly
+ * t0+floor(k*1e9/frequency) regardless of k.
+ */
+struct schedule {
+     uint64_t num;
+     uint64_t period;
+     uint64_t rem;
+     uint64_t t0;
+     uint64_t tick;
+     uint64_t t;
+     uint64_t acc;
+};
+
+/**
+ * Convert a frequency value to a time interval.
+ *
+ * @param frequency frequency in Hertz
+ * @return time interval
+ */
+struct timespec frequency_to_interval(double frequency);
+
+/**
+ * Calculate timestamp of next sample.
+ *
+ * @param tlast time of last sample
+ * @param interval sampling interval
+ * @return time of next sample
+ */
+struct timespec next_sampling_time(struct timespec tlast,
+				   struct timespec interval);
+
+/**
+ * Initialize a schedule. The schedule starts at time 0 until it is
+ * started by schedule_start().
+ *
+ * @param s the schedule
+ * @param frequency frequency in Hertz, which is rounded to multiples of
+ * 1/SCHEDULE_FREQUENCY_SCALE Hz
+ * @return 0 on success; -1 if the frequency is out of range (0,
+ * SCHEDULE_MAX_FREQUENCY].
+ */
+int schedule_init(struct schedule *s, double frequency);
+
+/**
+ * (Re-)start a schedule, i.e., set the deadline of tick 0.
+ *
+ * @param s the schedule
+ * @param t0 time of tick 0 in nanoseconds
+ */
+void schedule_start(struct schedule *s, uint64_t t0);
+
+/**
+ * Advance a schedule by a number of ticks.
+ *
+ * @param s the schedule
+ * @param ticks number of ticks
+ * @return the deadline of the new tick in nanoseconds
+ */
+uint64_t schedule_advance(struct schedule *s, uint64_t ticks);
+
+/**
+ * Calculate the deadline of an arbitrary tick of a schedule directly.
+ *
+ * @param s the schedule
+ * @param tick the tick
+ * @return the deadline of the tick in nanoseconds
+ */
+uint64_t schedule_deadline(const struct schedule *s, uint64_t tick);
+
+/**
+ * Convert timespec values (sec, ns) to 64 bit nanosecond value.
+ *
+ * @param t timespec values
+ * @return value in nanoseconds corresponding to timespec values
+ */
+uint64_t to_nanosec(struct timespec t);
+
+/**
+ * Convert a 64 bit nanosecond value to timespec values (sec, ns).
+ *
+ * @param t_ns value in nanoseconds
+ * @return timespec values corresponding to the nanosecond value
+ */
+struct timespec to_timespec(uint64_t t_ns);
+
+#endif
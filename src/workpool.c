@@ -0,0 +1,177 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "workpool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct workpool;
+
+struct worker {
+     /* Range of tasks [next, end) still to be executed by this worker. */
+     size_t next;
+     size_t end;
+
+     unsigned int id;
+     struct workpool *pool;
+     
+     pthread_t thread;
+     pthread_mutex_t mutex;
+};
+
+struct workpool {
+     struct worker *workers;
+     unsigned int nworkers;
+
+     workpool_fn fn;
+     void *ctx;
+};
+
+/**
+ * Take the next task from the range of a worker.
+ *
+ * @param w the worker
+ * @param task index of the taken task
+ * @return true if a task was taken, false if the range was empty.
+ */
+static bool take_task(struct worker *w, size_t *task)
+{
+     bool taken = false;
+     
+     pthread_mutex_lock(&w->mutex);
+     if (w->next < w->end) {
+	  *task = w->next++;
+	  taken = true;
+     }
+     pthread_mutex_unlock(&w->mutex);
+
+     return taken;
+}
+
+/**
+ * Steal half of the remaining tasks from another worker.
+ *
+ * @param thief the worker stealing tasks; its own range must be empty
+ * @return true if tasks were stolen, false if all other ranges were empty.
+ */
+static bool steal_tasks(struct worker *thief)
+{
+     struct workpool *pool = thief->pool;
+     
+     for (unsigned int i = 1; i < pool->nworkers; i++) {
+	  struct worker *victim =
+	       &pool->workers[(thief->id+i)%pool->nworkers];
+	  
+	  pthread_mutex_lock(&victim->mutex);
+	  size_t remaining = victim->end-victim->next;
+	  if (remaining == 0) {
+	       pthread_mutex_unlock(&victim->mutex);
+	       continue;
+	  }
+	  /* Steal from the end of the range, so the victim keeps on
+	     executing tasks in order. */
+	  size_t cnt = (remaining+1)/2;
+	  victim->end -= cnt;
+	  size_t begin = victim->end;
+	  pthread_mutex_unlock(&victim->mutex);
+
+	  pthread_mutex_lock(&thief->mutex);
+	  thief->next = begin;
+	  thief->end = begin+cnt;
+	  pthread_mutex_unlock(&thief->mutex);
+	  
+	  return true;
+     }
+
+     return false;
+}
+
+/**
+ * Main loop of worker threads.
+ */
+static void *worker_loop(void *args)
+{
+     struct worker *w = (struct worker *) args;
+     size_t task;
+     
+     while (true) {
+	  if (take_task(w, &task))
+	       w->pool->fn(w->pool->ctx, task);
+	  else if (!steal_tasks(w))
+	       break;
+     }
+
+     return NULL;
+}
+
+int workpool_run(unsigned int nworkers, size_t ntasks, workpool_fn fn,
+		 void *ctx)
+{
+     if (nworkers <= 1 || ntasks <= 1) {
+	  for (size_t task = 0; task < ntasks; task++)
+	       fn(ctx, task);
+	  return 0;
+     }
+
+     if (nworkers > ntasks)
+	  nworkers = ntasks;
+     
+     struct workpool pool;
+     pool.nworkers = nworkers;
+     pool.fn = fn;
+     pool.ctx = ctx;
+     pool.workers = malloc(nworkers*sizeof(struct worker));
+     if (pool.workers == NULL)
+	  return -1;
+
+     for (unsigned int i = 0; i < nworkers; i++) {
+	  struct worker *w = &pool.workers[i];
+	  w->id = i;
+	  w->pool = &pool;
+	  w->next = ntasks*i/nworkers;
+	  w->end = ntasks*(i+1)/nworkers;
+	  pthread_mutex_init(&w->mutex, NULL);
+     }
+
+     /* The calling thread acts as worker 0. */
+     int status = 0;
+     unsigned int started = 1;
+     for (; started < nworkers; started++) {
+	  struct worker *w = &pool.workers[started];
+	  if (pthread_create(&w->thread, NULL, worker_loop, w)) {
+	       status = -1;
+	       break;
+	  }
+     }
+     
+     /* Even if not all threads could be created, the running workers
+	(at least the calling thread) steal all tasks. */
+     worker_loop(&pool.workers[0]);
+
+     for (unsigned int i = 1; i < started; i++)
+	  pthread_join(pool.workers[i].thread, NULL);
+
+     for (unsigned int i = 0; i < nworkers; i++)
+	  pthread_mutex_destroy(&pool.workers[i].mutex);
+     free(pool.workers);
+
+     return status;
+}
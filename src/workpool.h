@@ -0,0 +1,54 @@
+/**
+ * This file is part of Low-Energy-Meter.
+ *
+ * Copyright 2016 Frank Dürr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stddef.h>
+
+/**
+ * Function executing a single task of a work pool.
+ *
+ * @param ctx context shared by all tasks
+ * @param task index of the task to be executed
+ */
+typedef void (*workpool_fn)(void *ctx, size_t task);
+
+/**
+ * Execute a set of independent tasks on a pool of worker threads.
+ *
+ * Tasks are initially distributed in contiguous ranges over the workers.
+ * A worker running out of tasks steals half of the remaining range of
+ * another worker, so workers stay busy even if tasks differ in size.
+ * With a single worker, all tasks are executed by the calling thread in
+ * order.
+ *
+ * The function returns after all tasks have been executed.
+ *
+ * @param nworkers number of worker threads
+ * @param ntasks number of tasks with indices 0 to ntasks-1
+ * @param fn function executing a task
+ * @param ctx context passed to fn
+ * @return 0 on success, or -1 if not all worker threads could be created
+ * (all tasks are executed by the remaining workers nevertheless).
+ */
+int workpool_run(unsigned int nworkers, size_t ntasks, workpool_fn fn,
+		 void *ctx);
+
+#endif